@@ -0,0 +1,178 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "metrics.h"
+
+struct job {
+	char *path;
+	int failed;
+	unsigned long long hash;
+	unsigned long long instructions;
+	double secs;
+};
+
+struct pool {
+	struct job *jobs;
+	size_t njobs;
+	atomic_size_t next;
+	unsigned long frames;
+	const struct engine *engine;
+	int busy;
+};
+
+static void run_job(struct pool *p, struct job *j, struct chip8 *c8){
+	unsigned char rom[0x1000-0x200];
+	size_t size;
+
+	FILE *f = fopen(j->path, "r");
+	if(!f){
+		j->failed = 1;
+		return;
+	}
+	size = fread(rom, 1, sizeof(rom), f);
+	j->failed = ferror(f);
+	fclose(f);
+	if(j->failed)
+		return;
+
+	double start = now();
+	reset(c8, rom, size);
+	for(unsigned long i=0 ; i<p->frames ; i++){
+		run(c8, FREQ/60);
+		tick(c8);
+	}
+	j->secs = now() - start;
+	j->instructions = (unsigned long long)p->frames*(FREQ/60);
+	j->hash = fnv1a(c8->SCREEN, sizeof(c8->SCREEN));
+}
+
+static void *worker(void *arg){
+	struct pool *p = arg;
+	struct chip8 *c8 = calloc(1, sizeof(*c8));
+	if(!c8){ /* the other workers take its jobs */
+		perror("batch");
+		return NULL;
+	}
+
+	c8->engine = p->engine;
+	c8->busy = p->busy;
+	for(size_t i ; (i = atomic_fetch_add(&p->next, 1)) < p->njobs ; )
+		run_job(p, &p->jobs[i], c8);
+
+	release(c8);
+	free(c8);
+	return NULL;
+}
+
+static int read_list(struct pool *p, const char *list){
+	FILE *f = fopen(list, "r");
+	if(!f){
+		perror(list);
+		return 0;
+	}
+
+	char line[4096];
+	size_t cap = 0;
+	int ok = 1;
+	while(fgets(line, sizeof(line), f)){
+		line[strcspn(line, "\r\n")] = 0;
+		if(!line[0] || line[0] == '#')
+			continue;
+		if(p->njobs == cap){
+			size_t new_cap = cap ? 2*cap : 64;
+			struct job *jobs = realloc(p->jobs, new_cap*sizeof(*jobs));
+			if(!jobs){
+				ok = 0;
+				break;
+			}
+			p->jobs = jobs;
+			cap = new_cap;
+		}
+		/* failed until run_job() says otherwise */
+		struct job j = {.path = strdup(line), .failed = 1};
+		if(!j.path){
+			ok = 0;
+			break;
+		}
+		p->jobs[p->njobs++] = j;
+	}
+	if(!ok)
+		perror("batch");
+	fclose(f);
+	return ok;
+}
+
+static void free_jobs(struct pool *p){
+	for(size_t i=0 ; i<p->njobs ; i++)
+		free(p->jobs[i].path);
+	free(p->jobs);
+}
+
+int batch(const char *list, unsigned long frames,
+		const struct engine *engine, int busy, unsigned threads){
+	struct pool p = {.frames = frames, .engine = engine, .busy = busy};
+
+	if(!read_list(&p, list)){
+		free_jobs(&p);
+		return 2;
+	}
+
+	if(!threads){
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cores > 0 ? cores : 1;
+	}
+	if(threads > p.njobs)
+		threads = p.njobs ? p.njobs : 1;
+
+	pthread_t *tids = calloc(threads, sizeof(*tids));
+	if(!tids){
+		perror("batch");
+		free_jobs(&p);
+		return 2;
+	}
+	double start = now();
+	unsigned started = 0;
+	for( ; started<threads ; started++){
+		int err = pthread_create(&tids[started], NULL, worker, &p);
+		if(err){ /* go on with the ones already running, if any */
+			errno = err;
+			perror("batch");
+			break;
+		}
+	}
+	for(unsigned t=0 ; t<started ; t++)
+		pthread_join(tids[t], NULL);
+	double secs = now() - start;
+	free(tids);
+	if(!started){
+		free_jobs(&p);
+		return 2;
+	}
+	threads = started;
+
+	unsigned long long total = 0;
+	int failed = 0;
+	for(size_t i=0 ; i<p.njobs ; i++){
+		struct job *j = &p.jobs[i];
+		if(j->failed){
+			printf("%-16s %12s %9s %s\n", "error", "-", "-", j->path);
+			failed = 1;
+		} else {
+			printf("%016llx %12llu %9.4f %s\n",
+					j->hash, j->instructions, j->secs, j->path);
+			total += j->instructions;
+		}
+	}
+	free_jobs(&p);
+
+	fprintf(stderr, "%zu ROMs, %u threads, %.3fs, %.2f MIPS\n",
+			p.njobs, threads, secs, total/secs/1e6);
+
+	return failed ? 4 : 0;
+}
@@ -0,0 +1,15 @@
+#ifndef C8_BATCH_H
+#define C8_BATCH_H
+
+#include "chip8.h"
+
+/*
+ * Run every ROM listed in the file (one path per line) headless for the
+ * given number of frames, on a pool of threads (0: one per core), busy
+ * turning off idle loop skipping. Prints one line per ROM: screen hash,
+ * instructions, seconds and path.
+ */
+int batch(const char *list, unsigned long frames,
+		const struct engine *engine, int busy, unsigned threads);
+
+#endif /* C8_BATCH_H */
@@ -0,0 +1,167 @@
+#include <stdlib.h>
+
+#include "callgraph.h"
+
+#define ROOT 0x1000 /* entry of the root, beyond any address */
+
+struct node {
+	unsigned short entry;
+	unsigned parent, child, sibling; /* 0 for none, the root is 0 */
+	unsigned long long self; /* instructions executed in this path */
+};
+
+struct callgraph {
+	struct node *nodes;
+	unsigned count, max;
+
+	unsigned current;
+	unsigned char sp; /* SP of the current node */
+};
+
+struct callgraph *callgraph_new(const struct chip8 *c8){
+	struct callgraph *g = calloc(1, sizeof(*g));
+	if(!g)
+		return NULL;
+	g->max = 256;
+	if(!(g->nodes = calloc(g->max, sizeof(*g->nodes)))){
+		free(g);
+		return NULL;
+	}
+	g->nodes[0].entry = ROOT;
+	g->count = 1;
+	g->sp = c8->SP;
+	return g;
+}
+
+void callgraph_free(struct callgraph *g){
+	if(!g)
+		return;
+	free(g->nodes);
+	free(g);
+}
+
+/* node for a call to entry from parent, the parent if out of memory */
+static unsigned call(struct callgraph *g, unsigned parent, unsigned short entry){
+	unsigned i;
+	for(i = g->nodes[parent].child ; i ; i = g->nodes[i].sibling)
+		if(g->nodes[i].entry == entry)
+			return i;
+
+	if(g->count == g->max){
+		struct node *nodes = realloc(g->nodes, 2*g->max*sizeof(*nodes));
+		if(!nodes)
+			return parent;
+		g->nodes = nodes;
+		g->max *= 2;
+	}
+	i = g->count++;
+	g->nodes[i] = (struct node){
+		.entry = entry,
+		.parent = parent,
+		.sibling = g->nodes[parent].child,
+	};
+	g->nodes[parent].child = i;
+	return i;
+}
+
+void callgraph_step(struct callgraph *g, const struct chip8 *c8){
+	g->nodes[g->current].self++;
+
+	/* one instruction moves SP by one at most */
+	if(c8->SP > g->sp)
+		g->current = call(g, g->current, c8->PC);
+	else if(c8->SP < g->sp)
+		g->current = g->nodes[g->current].parent;
+	g->sp = c8->SP;
+}
+
+static void write_path(FILE *f, const struct callgraph *g, unsigned i){
+	if(i)
+		write_path(f, g, g->nodes[i].parent);
+	if(g->nodes[i].entry == ROOT)
+		fprintf(f, "main");
+	else
+		fprintf(f, ";sub_%03X", (unsigned)g->nodes[i].entry);
+}
+
+int callgraph_write(const struct callgraph *g, const char *path){
+	FILE *f = fopen(path, "w");
+	if(!f)
+		return -1;
+
+	for(unsigned i=0 ; i<g->count ; i++){
+		if(!g->nodes[i].self)
+			continue;
+		write_path(f, g, i);
+		fprintf(f, " %llu\n", g->nodes[i].self);
+	}
+
+	int err = ferror(f);
+	if(fclose(f) || err)
+		return -1;
+	return 0;
+}
+
+struct totals {
+	unsigned long long inclusive[ROOT+1], exclusive[ROOT+1];
+};
+
+static const struct totals *sorting;
+
+static int by_inclusive(const void *a, const void *b){
+	unsigned long long ia = sorting->inclusive[*(const unsigned short *)a];
+	unsigned long long ib = sorting->inclusive[*(const unsigned short *)b];
+	return ia < ib ? 1 : ia > ib ? -1 : 0;
+}
+
+void callgraph_report(const struct callgraph *g, FILE *f){
+	/* children come after their parent, add subtrees up from the end */
+	unsigned long long *subtree = malloc(g->count*sizeof(*subtree));
+	struct totals *t = calloc(1, sizeof(*t));
+	if(!subtree || !t){
+		free(subtree);
+		free(t);
+		return;
+	}
+	for(unsigned i=0 ; i<g->count ; i++)
+		subtree[i] = g->nodes[i].self;
+	for(unsigned i=g->count-1 ; i ; i--)
+		subtree[g->nodes[i].parent] += subtree[i];
+
+	for(unsigned i=0 ; i<g->count ; i++){
+		unsigned short entry = g->nodes[i].entry;
+		t->exclusive[entry] += g->nodes[i].self;
+
+		/* recursive calls are already inside the outermost one */
+		unsigned a = i;
+		while(a && g->nodes[g->nodes[a].parent].entry != entry)
+			a = g->nodes[a].parent;
+		if(!a)
+			t->inclusive[entry] += subtree[i];
+	}
+
+	unsigned short order[ROOT+1];
+	unsigned n = 0;
+	for(unsigned e=0 ; e<=ROOT ; e++)
+		if(t->inclusive[e])
+			order[n++] = e;
+	sorting = t;
+	qsort(order, n, sizeof(*order), by_inclusive);
+
+	unsigned long long total = subtree[0];
+	fprintf(f, "%-8s %14s %7s %14s %7s\n", "entry", "inclusive", "%", "exclusive", "%");
+	for(unsigned i=0 ; i<n ; i++){
+		unsigned e = order[i];
+		char name[16];
+		if(e == ROOT)
+			snprintf(name, sizeof(name), "main");
+		else
+			snprintf(name, sizeof(name), "sub_%03X", e);
+		fprintf(f, "%-8s %14llu %6.2f%% %14llu %6.2f%%\n", name,
+				t->inclusive[e], 100.0*t->inclusive[e]/total,
+				t->exclusive[e], 100.0*t->exclusive[e]/total);
+	}
+
+	free(subtree);
+	free(t);
+}
@@ -0,0 +1,27 @@
+#ifndef C8_CALLGRAPH_H
+#define C8_CALLGRAPH_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+/*
+ * Call tree of the ROM's subroutines, rebuilt from SP as 2NNN and 00EE
+ * move it, with the instructions executed directly in each call path.
+ * run() feeds it one step() at a time while c8->calls is set.
+ */
+struct callgraph;
+
+/* the current call path is the root, "main", whatever SP is */
+struct callgraph *callgraph_new(const struct chip8 *c8);
+void callgraph_free(struct callgraph *g);
+
+/* after each step() */
+void callgraph_step(struct callgraph *g, const struct chip8 *c8);
+
+/* folded stacks for flamegraph.pl, 0 on success, -1 with errno set */
+int callgraph_write(const struct callgraph *g, const char *path);
+/* inclusive and exclusive counts per subroutine, most inclusive first */
+void callgraph_report(const struct callgraph *g, FILE *f);
+
+#endif /* C8_CALLGRAPH_H */
@@ -1,441 +1,392 @@
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 #include <unistd.h>
 
+#include "batch.h"
+#include "callgraph.h"
+#include "chip8.h"
+#include "diff.h"
+#include "hotspots.h"
+#include "lockstep.h"
 #include "media.h"
-
-#define FREQ 840
-#define STACK_SIZE 24
-
-unsigned char RAM[0x1000];
-
-unsigned char V[16];
-unsigned short I;
-
-unsigned char DT;
-unsigned char ST;
-
-unsigned short PC=0x200;
-unsigned char SP;
-
-unsigned short STACK[STACK_SIZE];
-
-unsigned short KEYBOARD;
-
-unsigned char SCREEN[256];
-
-#define CHAR_SPRITES_OFFSET 0x100
-char char_sprites[80] = {
-	/* Source: Cowgod's Chip-8 Technical Reference */
-	/* 0 */
-	0xF0,
-	0x90,
-	0x90,
-	0x90,
-	0xF0,
-	/* 1 */
-	0x20,
-	0x60,
-	0x20,
-	0x20,
-	0x70,
-	/* 2 */
-	0xF0,
-	0x10,
-	0xF0,
-	0x80,
-	0xF0,
-	/* 3 */
-	0xF0,
-	0x10,
-	0xF0,
-	0x10,
-	0xF0,
-	/* 4 */
-	0x90,
-	0x90,
-	0xF0,
-	0x10,
-	0x10,
-	/* 5 */
-	0xF0,
-	0x80,
-	0xF0,
-	0x10,
-	0xF0,
-	/* 6 */
-	0xF0,
-	0x80,
-	0xF0,
-	0x90,
-	0xF0,
-	/* 7 */
-	0xF0,
-	0x10,
-	0x20,
-	0x40,
-	0x40,
-	/* 8 */
-	0xF0,
-	0x90,
-	0xF0,
-	0x90,
-	0xF0,
-	/* 9 */
-	0xF0,
-	0x90,
-	0xF0,
-	0x10,
-	0xF0,
-	/* A */
-	0xF0,
-	0x90,
-	0xF0,
-	0x90,
-	0x90,
-	/* B */
-	0xE0,
-	0x90,
-	0xE0,
-	0x90,
-	0xE0,
-	/* C */
-	0xF0,
-	0x80,
-	0x80,
-	0x80,
-	0xF0,
-	/* D */
-	0xE0,
-	0x90,
-	0x90,
-	0x90,
-	0xE0,
-	/* E */
-	0xF0,
-	0x80,
-	0xF0,
-	0x80,
-	0xF0,
-	/* F */
-	0xF0,
-	0x80,
-	0xF0,
-	0x80,
-	0x80,
-};
-
-/* instructions are a 2 char array */
-
-#define I_SHORT(instr) (short)((instr)[0]<<8u | (instr)[1])
-#define I_CLASS(instr) ((instr)[0]>>4u)
-#define I_NNN(instr) ((((instr)[0]&15u)<<8u) | (instr)[1])
-#define I_ADDR(instr) I_NNN(instr)
-#define I_NN(instr) ((instr)[1])
-#define I_N(instr) ((instr)[1]&15u)
-#define I_X(instr) ((instr)[0]&15u)
-#define I_Y(instr) ((instr)[1]>>4u)
-
-#define WARN(...) (fprintf(stderr, __VA_ARGS__))
-
-static void display(){
-	for(int y=0 ; y<32 ; y++){
-		for(int x=0 ; x<64 ; x++){
-			draw(x, y, SCREEN[y*8+x/8]&1<<(7-x%8) ? 1:0);
-		}
-	}
+#include "metrics.h"
+#include "movie.h"
+#include "profile.h"
+#include "rewind.h"
+#include "state.h"
+#include "trace.h"
+
+#ifndef ENGINE
+#define ENGINE "call"
+#endif
+
+/* assumed host display refresh rate, turbo presents no faster */
+#define REFRESH 60
+
+/* batch and lockstep default: 10 seconds of emulated time */
+#define FRAMES 600
+
+/* memory for rewind snapshots */
+#define HISTORY_SIZE (4<<20)
+
+/* where SIGUSR1 and faults dump the trace, without -T */
+#define TRACE_FILE "chip8.trace"
+
+#ifdef C8_TRACE
+#define TRACE_OPT "T:"
+#define TRACE_USAGE " [-T trace]"
+#else
+#define TRACE_OPT ""
+#define TRACE_USAGE ""
+#endif
+
+static unsigned char ROM[0x1000-0x200];
+static size_t rom_size;
+
+static struct chip8 c8;
+static const void *state; /* -L, loaded after every reset */
+static int seeded; /* -s */
+static unsigned seed;
+static struct movie *replay; /* -p */
+
+#ifdef C8_TRACE
+static volatile sig_atomic_t dump_requested;
+
+static void request_dump(int sig){
+	(void)sig;
+	dump_requested = 1;
 }
 
-static void step(){
-	if(PC < 0x200 || PC >= 0x1000){
-		WARN("PC out of usable adress space: %X\n", (unsigned) PC);
-		return; /*TODO: abort? */
-	}
+/* on SIGUSR1, and on the first fault */
+static void check_trace(const char *path){
+	static int fault_dumped;
 
-	unsigned char instr[2] = {RAM[PC], RAM[PC+1]};
-	/* TODO: debug: print state */
-	PC+=2;
-	switch(I_CLASS(instr)){
-		case 0:
-			switch(I_SHORT(instr)){
-				case 0x00E0: /* clear screen */
-					for(int i=0 ; i<256 ; i++)
-						SCREEN[i] = 0;
-					clear_screen();
-					frame();
-					return;
-				case 0x00EE: /* return from a subroutine */
-					if(!SP)
-						WARN("Stack underflow\n");
-					else
-						PC=STACK[--SP];
-					return;
-				default: /* legacy machine routine call */
-					WARN("Legacy machine routine call: %X\n",
-							(unsigned) I_SHORT(instr));
-					return;
-			}
-			return;
-		case 1: /* jump */
-			PC=I_ADDR(instr);
-			return;
-		case 2: /* call a subroutine */
-			if(SP==STACK_SIZE)
-				WARN("Stack overflow\n");
-			else
-				STACK[SP++] = PC;
-			PC=I_ADDR(instr);
-			return;
-		case 3:
-			if(V[I_X(instr)] == I_NN(instr))
-				PC+=2;
-			return;
-		case 4:
-			if(V[I_X(instr)] != I_NN(instr))
-				PC+=2;
-			return;
-		case 5:
-			if(V[I_X(instr)] == V[I_Y(instr)])
-				PC+=2;
-			return;
-		case 6:
-			V[I_X(instr)] = I_NN(instr);
-			return;
-		case 7:
-			V[I_X(instr)] += I_NN(instr);
-			return;
-		case 8:
-			switch(I_N(instr)){
-				case 0:
-					V[I_X(instr)] = V[I_Y(instr)];
-					return;
-				case 1:
-					V[I_X(instr)] |= V[I_Y(instr)];
-					return;
-				case 2:
-					V[I_X(instr)] &= V[I_Y(instr)];
-					return;
-				case 3:
-					V[I_X(instr)] ^= V[I_Y(instr)];
-					return;
-				case 4:
-					V[0xf] = V[I_X(instr)] + V[I_Y(instr)] > 0xff ? 1 : 0;
-					V[I_X(instr)] += V[I_Y(instr)];
-					return;
-				case 5:
-					V[0xf] = V[I_X(instr)] > V[I_Y(instr)] ? 1 : 0;
-					V[I_X(instr)] -= V[I_Y(instr)];
-					return;
-				case 6:
-					V[0xf] = V[I_X(instr)]&1u;
-					V[I_X(instr)] >>= 1u;
-					return;
-				case 7:
-					V[0xf] = V[I_X(instr)] < V[I_Y(instr)] ? 1 : 0;
-					V[I_X(instr)] = V[I_Y(instr)] - V[I_X(instr)] ;
-					return;
-				case 0xE:
-					V[0xf] = V[I_X(instr)]>>7u;
-					V[I_X(instr)] <<= 1u;
-					return;
-
-				default: /* unknown instruction */
-					WARN("Unknown instruction: %X\n",
-							(unsigned) I_SHORT(instr));
-					return;
-			}
-			return;
-		case 9:
-			if(V[I_X(instr)] != V[I_Y(instr)])
-				PC+=2;
-			return;
-		case 0xA:
-			I=I_ADDR(instr);
-			return;
-		case 0xB:
-			PC = I_ADDR(instr) + V[0];
-			return;
-		case 0xC:
-			V[I_X(instr)] = rand() & I_NN(instr);
-			return;
-		case 0xD: /* display */
-			if(I+I_N(instr) >= 0x1000){
-				WARN("Sprite data out of memory bounds: %X..%X\n",
-						(unsigned)I, (unsigned)(I+I_N(instr)));
-				return;
-			}
+	if(!dump_requested && (!c8.trace->faulted || fault_dumped))
+		return;
+	if(c8.trace->faulted)
+		fault_dumped = 1;
+	dump_requested = 0;
 
-			V[0xf] = 0;
-			unsigned char x = V[I_X(instr)];
-			unsigned char y = V[I_Y(instr)];
-			unsigned char shift = x%8;
-
-			for(unsigned i=0;i<I_N(instr);i++){
-				unsigned char wrapped_y = (y+i)%32;
-				unsigned char *screen_tile = &SCREEN[wrapped_y*8+(x/8)%8];
-				unsigned char sprite_tile = RAM[I+i]>>shift;
-				V[0xf] |= *screen_tile & sprite_tile ? 1:0;
-				*screen_tile ^= sprite_tile;
-				if(shift){
-					screen_tile = &SCREEN[wrapped_y*8+(x/8+1)%8];
-					sprite_tile = RAM[I+i]<<(8u-shift);
-					V[0xf] |= *screen_tile & sprite_tile ? 1:0;
-					*screen_tile ^= sprite_tile;
-				}
-			}
+	if(trace_dump(c8.trace, path))
+		perror(path);
+	else
+		fprintf(stderr, "Trace written to %s\n", path);
+}
+#endif
+
+/* power on, then apply -L, -s and -p */
+static void start(void){
+	reset(&c8, ROM, rom_size);
+	if(state)
+		restore(&c8, state);
+	if(seeded)
+		c8.seed = seed;
+	if(replay)
+		c8.seed = replay->seed;
+}
 
-			/*TODO: maybe update only written regions */
-			display();
-			return;
-
-		case 0xE:
-			switch(I_NN(instr)){
-				case 0x9E:
-					if(V[I_X(instr)] > 16)
-						WARN("Unknown key: %u\n",
-								(unsigned)V[I_X(instr)]);
-					if(KEYBOARD & 1<<(V[I_X(instr)]))
-						PC+=2;
-					return;
-				case 0xA1:
-					if(V[I_X(instr)] > 16)
-						WARN("Unknown key: %u\n",
-								(unsigned)V[I_X(instr)]);
-					if(!(KEYBOARD & 1<<(V[I_X(instr)])))
-						PC+=2;
-					return;
-				default: /* unknown instruction */
-					WARN("Unknown instruction: %X\n",
-							(unsigned) I_SHORT(instr));
-					return;
-				
-			}
-			return;
-		case 0xF:
-			switch(I_NN(instr)){
-				case 0x07:
-					V[I_X(instr)]=DT;
-					return;
-				case 0x0A:
-					if(!KEYBOARD)
-						PC-=2;
-					else {
-						V[I_X(instr)]=0;
-						for(unsigned short k=KEYBOARD;!(k&1);k>>=1)
-							V[I_X(instr)]++;
-					}
-					return;
-				case 0x15:
-					DT=V[I_X(instr)];
-					return;
-				case 0x18:
-					ST=V[I_X(instr)];
-					return;
-				case 0x1E:
-					I+=V[I_X(instr)];
-					/* Undocumented feature, reported on Wikipedia */
-					V[0xf] = I >= 0x1000 ? 1 : 0;
-					I &= 0xfff;
-					return;
-				case 0x29:
-					if(V[I_X(instr)]>0xF)
-						WARN("Too large input for a digit: %X\n",
-								(unsigned)V[I_X(instr)]);
-					else
-						I = CHAR_SPRITES_OFFSET + 5*V[I_X(instr)];
-					return;
-				case 0x33:
-					if(I<0x200 || I+3 >= 0x1000){
-						WARN("BCD store out of memory bounds: %X..%X\n",
-								(unsigned)I, (unsigned)(I+3));
-						return;
-					}
-
-					RAM[I+2] = V[I_X(instr)]%10;
-					RAM[I+1] = (V[I_X(instr)]/10)%10;
-					RAM[I]   = (V[I_X(instr)]/100)%10;
-					return;
-				case 0x55:
-					if(I<0x200 || I+I_X(instr) >= 0x1000){
-						WARN("Register store out of memory bounds: %X..%X\n",
-								(unsigned)I,
-								(unsigned)(I+I_X(instr)));
-						return;
-					}
-
-					for(unsigned i=0 ; i<=I_X(instr) ; i++)
-						RAM[I+i] = V[i];
-					return;
-				case 0x65:
-					if(I+I_X(instr) >= 0x1000){
-						WARN("Register load out of memory bounds: %X..%X\n",
-								(unsigned)I,
-								(unsigned)(I+I_X(instr)));
-						return;
-					}
-
-					for(unsigned i=0 ; i<=I_X(instr) ; i++)
-						V[i] = RAM[I+i];
-					return;
-				default: /* unknown instruction */
-					WARN("Unknown instruction: %X\n",
-							(unsigned) I_SHORT(instr));
-					return;
-			}
-			return;
-		default: /* unreachable */
-			/*TODO: assert */
-			return;
+/* run the ROM headless on every engine, report instructions per second */
+static void bench(unsigned long count){
+	unsigned long frames = count/(FREQ/60) + 1;
+
+	for(const struct engine *e=engines ; e->name ; e++){
+		c8.engine = find_engine(e->name);
+		start();
+		profile_reset();
+		double t0 = now();
+		for(unsigned long f=0 ; f<frames ; f++){
+			if(replay)
+				c8.KEYBOARD = f < replay->frames ? replay->keys[f] : 0;
+			PROFILE(PROF_HOST, 1);
+			run(&c8, FREQ/60);
+			tick(&c8);
+			PROFILE(PROF_TICK, 1);
+		}
+		double secs = now() - t0;
+		release(&c8);
+
+		printf("%-8s %8.2f MIPS\n", e->name, frames*(FREQ/60)/secs/1e6);
+		profile_report(stdout);
 	}
+}
 
+static int usage(const char *argv0){
+	fprintf(stderr, "Usage: %s [-e engine] [-t] [-I] [-f frames] [-o status] [-H hits] [-g calls]\n"
+		"       %*s [-L state] [-S state] [-r interval] [-s seed] [-m movie | -p movie]" TRACE_USAGE " rom\n", argv0, (int)strlen(argv0), "");
+	fprintf(stderr, "       %s [-e engine] [-I] [-L state] [-s seed] [-p movie] -B [-n count] rom\n", argv0);
+	fprintf(stderr, "       %s [-e engine] [-I] -j list [-f frames] [-c threads]\n", argv0);
+	fprintf(stderr, "       %s -l lanes [-f frames] rom\n", argv0);
+	fprintf(stderr, "       %s -x engine|lockstep|rewind [-I] [-k every] [-f frames] rom | -R count\n", argv0);
+	fprintf(stderr, "Engines:");
+	for(const struct engine *e=engines ; e->name ; e++)
+		fprintf(stderr, " %s", e->name);
+	fprintf(stderr, " (default: %s)\n", ENGINE);
+	return 1;
 }
 
 int main(int argc, char **argv){
-	/* Set up char sprites */	
-	memcpy(RAM+CHAR_SPRITES_OFFSET, char_sprites, sizeof(char_sprites));
+	const char *engine_name = ENGINE;
+	int benchmark = 0;
+	unsigned long count = 100000000;
+	const char *list = NULL;
+	unsigned long frames = 0;
+	int turbo = 0;
+	const char *load = NULL, *save = NULL;
+	unsigned rewind_interval = 0;
+	const char *record_path = NULL, *replay_path = NULL;
+	const char *metrics_dest = "stderr";
+	const char *hits_path = NULL, *calls_path = NULL;
+#ifdef C8_TRACE
+	const char *trace_path = NULL;
+#endif
+	unsigned threads = 0;
+	unsigned lanes = 0;
+	const char *diff_name = NULL;
+	unsigned every = 1;
+	unsigned random_roms = 0;
+
+	for(int opt ; (opt = getopt(argc, argv, "e:Bn:j:f:c:l:tIL:S:r:s:m:p:o:H:g:x:k:R:" TRACE_OPT)) != -1 ; ){
+		switch(opt){
+			case 'e': engine_name = optarg; break;
+			case 'B': benchmark = 1; break;
+			case 'n': count = strtoul(optarg, NULL, 0); break;
+			case 'j': list = optarg; break;
+			case 'f': frames = strtoul(optarg, NULL, 0); break;
+			case 'c': threads = strtoul(optarg, NULL, 0); break;
+			case 'l': lanes = strtoul(optarg, NULL, 0); break;
+			case 't': turbo = 1; break;
+			case 'I': c8.busy = 1; break;
+			case 'L': load = optarg; break;
+			case 'S': save = optarg; break;
+			case 'r': rewind_interval = strtoul(optarg, NULL, 0); break;
+			case 's': seeded = 1; seed = strtoul(optarg, NULL, 0); break;
+			case 'm': record_path = optarg; break;
+			case 'p': replay_path = optarg; break;
+			case 'o': metrics_dest = optarg; break;
+			case 'H': hits_path = optarg; break;
+			case 'g': calls_path = optarg; break;
+			case 'x': diff_name = optarg; break;
+			case 'k': every = strtoul(optarg, NULL, 0); break;
+			case 'R': random_roms = strtoul(optarg, NULL, 0); break;
+#ifdef C8_TRACE
+			case 'T': trace_path = optarg; break;
+#endif
+			default: return usage(argv[0]);
+		}
+	}
+
+	c8.engine = find_engine(engine_name);
+	if(!c8.engine)
+		return usage(argv[0]);
+	/* a rewound movie would no longer replay */
+	if(rewind_interval && (record_path || replay_path))
+		return usage(argv[0]);
+
+	if(list)
+		return batch(list, frames ? frames : FRAMES, c8.engine, c8.busy, threads);
+
+	/* random instructions filling the whole ROM space, seeds 1 to count */
+	if(diff_name && random_roms){
+		for(unsigned s=1 ; s<=random_roms ; s++){
+			random_rom(ROM, sizeof(ROM), s);
+			int status = diff(diff_name, ROM, sizeof(ROM), frames ? frames : FRAMES, every, c8.busy);
+			if(status){
+				printf("in random ROM %u\n", s);
+				return status;
+			}
+		}
+		printf("%s: %u random ROMs match\n", diff_name, random_roms);
+		return 0;
+	}
 
 	/* Load ROM */
-	if(argc<2)
-		return 1;
-	FILE *rom=fopen(argv[1], "r");
+	if(optind >= argc)
+		return usage(argv[0]);
+	FILE *rom=fopen(argv[optind], "r");
 	if(!rom)
 		return 2;
-	fread(RAM+0x200,1,0x1000-0x200,rom);
+	rom_size = fread(ROM,1,sizeof(ROM),rom);
 	if(ferror(rom))
 		return 3;
 	fclose(rom);
 
+	if(lanes)
+		return lockstep(ROM, rom_size, lanes, frames ? frames : FRAMES);
+
+	if(diff_name){
+		int status = diff(diff_name, ROM, rom_size, frames ? frames : FRAMES, every, c8.busy);
+		if(!status)
+			printf("%s: %s matches\n", diff_name, argv[optind]);
+		return status;
+	}
+
+	if(load && !(state = map_state(load))){
+		perror(load);
+		return 2;
+	}
+
+	if(replay_path && !(replay = movie_load(replay_path, ROM, rom_size))){
+		perror(replay_path);
+		return 2;
+	}
+
+#ifdef C8_TRACE
+	if(!(c8.trace = trace_new())){
+		perror("trace");
+		return 2;
+	}
+	signal(SIGUSR1, request_dump);
+#endif
+
+	if(benchmark){
+		bench(count);
+		return 0;
+	}
+
+	/* Set up char sprites, RAM and registers */
+	start();
+
+	if(hits_path && !(c8.hits = calloc(0x1000, sizeof(*c8.hits)))){
+		perror(hits_path);
+		return 2;
+	}
+
+	if(calls_path && !(c8.calls = callgraph_new(&c8))){
+		perror(calls_path);
+		return 2;
+	}
+
+	struct movie *record = NULL;
+	if(record_path && !(record = movie_new(c8.seed, ROM, rom_size))){
+		perror(record_path);
+		return 2;
+	}
+
+	struct history *history = NULL;
+	if(rewind_interval && !(history = history_new(HISTORY_SIZE, rewind_interval))){
+		perror("rewind");
+		return 2;
+	}
+
 	/* Init media stuff: graphics, input, sound */
-	m_init(argc, argv);
+	if(m_init(argc, argv))
+		return 2;
 
-	/* Let's go */
-	for(int i=0 ; 1 ; i++){
-		KEYBOARD = get_input(KEYBOARD);
-		if(KEYBOARD == (unsigned short)-1)
-			break;
+	struct metrics metrics;
+	if(metrics_open(&metrics, metrics_dest, now())){
+		perror(metrics_dest);
+		m_quit();
+		return 2;
+	}
 
-		step();
-		
-		if(!(i%(FREQ/60))){
-			frame();
-			if(DT)
-				DT--;
-			if(ST)
-				ST--;
+	/*
+	 * Let's go, one emulated 60Hz frame at a time. frame() waits for
+	 * vsync, so in turbo mode presenting (and polling input with it)
+	 * happens at most once per host refresh while emulated frames,
+	 * timers included, run flat out in between.
+	 */
+	double next_present = 0;
+	int present = 1;
+	profile_reset();
+	for(unsigned long f=0 ; !frames || f<frames ; f++){
+		if(present){
+			PROFILE(PROF_HOST, 0);
+			unsigned short keys = get_input(c8.KEYBOARD);
+			PROFILE(PROF_INPUT, 1);
+			if(keys == (unsigned short)-1)
+				break;
+			if(!replay)
+				c8.KEYBOARD = keys;
+
+			/* step back one snapshot per presented frame */
+			if(history && get_rewind()){
+				history_back(history, &c8);
+				display(&c8);
+				c8.KEYBOARD = keys;
+				frame();
+				continue;
+			}
 		}
 
-		set_buzzer_state(ST ? 1 : 0);
+		/* the movie has the keys of every frame, presented or not */
+		if(replay){
+			if(f >= replay->frames)
+				break;
+			c8.KEYBOARD = replay->keys[f];
+		}
+		if(record && movie_add(record, c8.KEYBOARD)){
+			perror(record_path);
+			break;
+		}
 
-		printf("i=%5d, DT=%3d, K=[", i, (int)DT);
-		for(int k=0 ; k<16;k++)
-			printf("%c", KEYBOARD & 1<<k ? "0123456789ABCDEF"[k]:'.');
-		printf("]      \r");
+		PROFILE(PROF_HOST, 1);
+		run(&c8, FREQ/60);
+		tick(&c8);
+		PROFILE(PROF_TICK, 1);
+		metrics.instructions += FREQ/60;
+		metrics.frames++;
+#ifdef C8_TRACE
+		check_trace(trace_path ? trace_path : TRACE_FILE);
+#endif
+		if(history)
+			history_frame(history, &c8);
+
+		if(turbo){
+			double t = now();
+			present = t >= next_present;
+			if(present)
+				next_present = t + 1.0/REFRESH;
+		}
+		if(!present)
+			continue;
+
+		/* the sprites of every frame since the last one, at once */
+		double t = now();
+		PROFILE(PROF_HOST, 0);
+		display(&c8);
+		frame();
+		set_buzzer_state(c8.ST ? 1 : 0);
+		PROFILE(PROF_FRAME, 1);
+		double t_end = now();
+		metrics.in_frame += t_end - t;
+		metrics.shown++;
+		metrics_report(&metrics, &c8, t_end);
 	}
 
 	/* Quit media */
+	metrics_close(&metrics, &c8, now());
 	m_quit();
+	profile_report(stderr);
+
+	if(save && save_state(&c8, save))
+		perror(save);
+
+	if(hits_path && write_hotspots(&c8, hits_path))
+		perror(hits_path);
+	free(c8.hits);
+
+	if(calls_path){
+		if(callgraph_write(c8.calls, calls_path))
+			perror(calls_path);
+		callgraph_report(c8.calls, stderr);
+		callgraph_free(c8.calls);
+	}
+
+	if(record && movie_save(record, record_path))
+		perror(record_path);
+
+#ifdef C8_TRACE
+	if(trace_path && trace_dump(c8.trace, trace_path))
+		perror(trace_path);
+	trace_free(c8.trace);
+#endif
+
+	movie_free(record);
+	movie_free(replay);
+	history_free(history);
+	release(&c8);
 
 	return 0;
 }
@@ -0,0 +1,152 @@
+#ifndef C8_CHIP8_H
+#define C8_CHIP8_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FREQ 840
+#define STACK_SIZE 24
+#define CHAR_SPRITES_OFFSET 0x100
+#define BIG_SPRITES_OFFSET 0x150 /* SCHIP 8x10 digits, after the 4x5 ones */
+
+/* every instruction form, in opcode order */
+#define OPCODES(X) \
+	X(00cn) X(00e0) X(00ee) X(00fb) X(00fc) X(00fd) X(00fe) X(00ff) \
+	X(0nnn) X(1nnn) X(2nnn) X(3xnn) X(4xnn) X(5xy0) X(6xnn) X(7xnn) \
+	X(8xy0) X(8xy1) X(8xy2) X(8xy3) X(8xy4) X(8xy5) X(8xy6) X(8xy7) \
+	X(8xye) X(9xy0) X(annn) X(bnnn) X(cxnn) X(dxyn) X(ex9e) X(exa1) \
+	X(fx07) X(fx0a) X(fx15) X(fx18) X(fx1e) X(fx29) X(fx30) X(fx33) \
+	X(fx55) X(fx65) X(fx75) X(fx85) X(unknown)
+
+enum {
+#define X(form) OP_##form,
+	OPCODES(X)
+#undef X
+};
+
+struct chip8;
+
+/* predecoded instruction: handler and pre-extracted operands */
+struct op {
+	union { /* depends on the engine that decoded it */
+		void (*exec)(struct chip8 *, const struct op *);
+		const void *label;
+	} h;
+	unsigned short instr;
+	unsigned short nnn;
+	unsigned char x, y, n, nn;
+	unsigned char id;
+};
+
+struct engine {
+	const char *name;
+	void (*run)(struct chip8 *c8, unsigned long n);
+	void (*init)(void); /* shared tables, see find_engine() */
+};
+
+/* a whole machine, zero it before the first reset() */
+struct chip8 {
+	unsigned char RAM[0x1000];
+
+	/*
+	 * 128x64 in SCHIP high resolution, 64x32 otherwise in the first 32
+	 * rows of the first column: two words per row, the leftmost pixel in
+	 * the top bit of the first
+	 */
+	uint64_t SCREEN[64][2];
+	unsigned char hires;
+
+	unsigned char V[16];
+	unsigned short I;
+
+	unsigned char DT;
+	unsigned char ST;
+
+	unsigned short PC;
+	unsigned char SP;
+
+	unsigned short STACK[STACK_SIZE];
+
+	unsigned short KEYBOARD;
+
+	unsigned int seed; /* CXNN random numbers */
+
+	unsigned char RPL[8]; /* SCHIP flags, FX75 and FX85 */
+
+	/* everything above is the machine state, see STATE_SIZE */
+
+	const struct engine *engine;
+	int busy; /* don't skip idle loops */
+	unsigned long long idle; /* instructions run as idle loops */
+	unsigned long long sprites; /* DXYN executed */
+	unsigned long long *hits; /* executions per address, counted if set */
+	struct callgraph *calls; /* see callgraph.h, fed if set */
+	unsigned idle_wait, idle_backoff; /* runs before looking again */
+
+	/* rows written since the last display(), and what that one showed */
+	uint64_t dirty;
+	uint64_t shown[64][2];
+	int redraw; /* shown is meaningless, display() sends the whole screen */
+
+	/* RAM (a bit per 64 bytes) and screen rows written, cleared by rewind */
+	uint64_t ram_written, rows_written;
+
+	/* one entry per even address, not decoded yet while h is NULL */
+	struct op OPS[0x1000/2];
+
+	struct jit *jit;
+#ifdef C8_TRACE
+	struct trace *trace; /* see trace.h, not tracing while NULL */
+#endif
+};
+
+/* leading bytes of struct chip8 that make up the machine state */
+#define STATE_SIZE offsetof(struct chip8, engine)
+
+extern const struct engine engines[];
+
+/* look an engine up and set up its shared tables, not thread safe */
+const struct engine *find_engine(const char *name);
+
+/* power-on state with the ROM loaded, the engine is kept */
+void reset(struct chip8 *c8, const unsigned char *rom, size_t size);
+/* load STATE_SIZE bytes copied from a chip8, the engine is kept */
+void restore(struct chip8 *c8, const void *state);
+/* free what the engine allocated */
+void release(struct chip8 *c8);
+
+/*
+ * execute n instructions, skipping trips around idle loops, or with hits
+ * or calls set one step() at a time, counting each
+ */
+void run(struct chip8 *c8, unsigned long n);
+/* 60Hz timers */
+void tick(struct chip8 *c8);
+/* hand the part of the screen changed since the last call to the media backend */
+void display(struct chip8 *c8);
+/*
+ * XOR n rows of an 8 pixel wide sprite at x, y with wrapping, 1 if a pixel
+ * was erased; n=0 draws 16 rows, 16 pixels wide in high resolution
+ */
+int draw_sprite(uint64_t SCREEN[64][2], int hires, const unsigned char *sprite,
+		unsigned n, unsigned x, unsigned y);
+/* bytes of sprite data DXYN reads */
+#define SPRITE_SIZE(n, hires) ((n) ? (n) : (hires) ? 32u : 16u)
+
+/* FNV-1a, to compare screens across runs */
+unsigned long long fnv1a(const void *p, size_t n);
+
+struct op decode(const unsigned char instr[2]);
+
+/* execute the instruction at PC */
+void step(struct chip8 *c8);
+
+#ifdef __x86_64__
+/* jit-x86_64.c */
+void run_jit(struct chip8 *c8, unsigned long n);
+void jit_invalidate(struct chip8 *c8, unsigned addr, unsigned len);
+void jit_flush(struct chip8 *c8);
+void jit_free(struct chip8 *c8);
+#endif
+
+#endif /* C8_CHIP8_H */
@@ -0,0 +1,985 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "callgraph.h"
+#include "media.h"
+#include "profile.h"
+#include "trace.h"
+
+char char_sprites[80] = {
+	/* Source: Cowgod's Chip-8 Technical Reference */
+	/* 0 */
+	0xF0,
+	0x90,
+	0x90,
+	0x90,
+	0xF0,
+	/* 1 */
+	0x20,
+	0x60,
+	0x20,
+	0x20,
+	0x70,
+	/* 2 */
+	0xF0,
+	0x10,
+	0xF0,
+	0x80,
+	0xF0,
+	/* 3 */
+	0xF0,
+	0x10,
+	0xF0,
+	0x10,
+	0xF0,
+	/* 4 */
+	0x90,
+	0x90,
+	0xF0,
+	0x10,
+	0x10,
+	/* 5 */
+	0xF0,
+	0x80,
+	0xF0,
+	0x10,
+	0xF0,
+	/* 6 */
+	0xF0,
+	0x80,
+	0xF0,
+	0x90,
+	0xF0,
+	/* 7 */
+	0xF0,
+	0x10,
+	0x20,
+	0x40,
+	0x40,
+	/* 8 */
+	0xF0,
+	0x90,
+	0xF0,
+	0x90,
+	0xF0,
+	/* 9 */
+	0xF0,
+	0x90,
+	0xF0,
+	0x10,
+	0xF0,
+	/* A */
+	0xF0,
+	0x90,
+	0xF0,
+	0x90,
+	0x90,
+	/* B */
+	0xE0,
+	0x90,
+	0xE0,
+	0x90,
+	0xE0,
+	/* C */
+	0xF0,
+	0x80,
+	0x80,
+	0x80,
+	0xF0,
+	/* D */
+	0xE0,
+	0x90,
+	0x90,
+	0x90,
+	0xE0,
+	/* E */
+	0xF0,
+	0x80,
+	0xF0,
+	0x80,
+	0xF0,
+	/* F */
+	0xF0,
+	0x80,
+	0xF0,
+	0x80,
+	0x80,
+};
+
+char big_sprites[160] = {
+	/* 0-9 as in SCHIP 1.1, A-F drawn to match */
+	0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, /* 0 */
+	0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, /* 1 */
+	0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, /* 2 */
+	0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, /* 3 */
+	0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, /* 4 */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, /* 5 */
+	0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, /* 6 */
+	0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, /* 7 */
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, /* 8 */
+	0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, /* 9 */
+	0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, /* A */
+	0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, /* B */
+	0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, /* C */
+	0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, /* D */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xFF, 0xFF, /* E */
+	0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xC0, 0xC0, /* F */
+};
+
+/* instructions are a 2 char array */
+
+#define I_SHORT(instr) (short)((instr)[0]<<8u | (instr)[1])
+#define I_CLASS(instr) ((instr)[0]>>4u)
+#define I_NNN(instr) ((((instr)[0]&15u)<<8u) | (instr)[1])
+#define I_ADDR(instr) I_NNN(instr)
+#define I_NN(instr) ((instr)[1])
+#define I_N(instr) ((instr)[1]&15u)
+#define I_X(instr) ((instr)[0]&15u)
+#define I_Y(instr) ((instr)[1]>>4u)
+
+#define PIXEL(row, x) ((row)[(x)/64] >> (63-(x)%64) & 1)
+
+void display(struct chip8 *c8){
+	unsigned width = c8->hires ? 128 : 64, height = width/2;
+	unsigned top = height, bottom = 0;
+	uint64_t columns[2] = {0, 0};
+
+	if(c8->redraw){
+		memcpy(c8->shown, c8->SCREEN, sizeof(c8->shown));
+		c8->redraw = 0;
+		c8->dirty = 0;
+		present((const uint64_t (*)[2])c8->SCREEN, width, height,
+				0, 0, width, height);
+		return;
+	}
+
+	for(unsigned y=0 ; y<height ; y++){
+		if(!(c8->dirty>>y & 1))
+			continue;
+		/* only the pixels the backend doesn't show yet */
+		uint64_t flips[2] = {
+			c8->SCREEN[y][0] ^ c8->shown[y][0],
+			c8->SCREEN[y][1] ^ c8->shown[y][1],
+		};
+		if(!(flips[0] | flips[1]))
+			continue;
+		memcpy(c8->shown[y], c8->SCREEN[y], sizeof(c8->shown[y]));
+		columns[0] |= flips[0];
+		columns[1] |= flips[1];
+		if(top > y)
+			top = y;
+		bottom = y+1;
+	}
+	c8->dirty = 0;
+
+	if(top < bottom){
+		unsigned left = 0, right = width;
+		while(left < right && !PIXEL(columns, left))
+			left++;
+		while(right > left && !PIXEL(columns, right-1))
+			right--;
+		if(left < right)
+			present((const uint64_t (*)[2])c8->SCREEN, width, height,
+					left, top, right-left, bottom-top);
+	}
+}
+
+/* the backend shows something else entirely, send it everything */
+static void repaint(struct chip8 *c8){
+	c8->redraw = 1;
+}
+
+/* rows y to y+n-1 changed, wrapping around the bottom */
+static void touch(struct chip8 *c8, unsigned y, unsigned n){
+	unsigned height = c8->hires ? 64 : 32;
+	uint64_t rows = n < 64 ? (1ull << n) - 1 : ~0ull;
+	rows = rows << y | (y ? rows >> (height-y) : 0);
+	rows = height == 64 ? rows : rows & 0xffffffff;
+	c8->dirty |= rows;
+	c8->rows_written |= rows;
+}
+
+/* drop predecoded instructions overlapping RAM[addr..addr+len) */
+static void invalidate(struct chip8 *c8, unsigned addr, unsigned len){
+	unsigned first = addr/64, last = (addr+len-1)/64;
+	c8->ram_written |= (~0ull >> (63-last+first)) << first;
+	for(unsigned a=addr ; a<addr+len ; a++)
+		c8->OPS[a/2].h.exec = NULL;
+#ifdef __x86_64__
+	jit_invalidate(c8, addr, len);
+#endif
+}
+
+static void op_00cn(struct chip8 *c8, const struct op *o){ /* scroll down n rows */
+	unsigned height = c8->hires ? 64 : 32;
+	memmove(c8->SCREEN[o->n], c8->SCREEN[0], (height-o->n)*sizeof(c8->SCREEN[0]));
+	memset(c8->SCREEN[0], 0, o->n*sizeof(c8->SCREEN[0]));
+	touch(c8, 0, height);
+}
+
+static void op_00e0(struct chip8 *c8, const struct op *o){ /* clear screen */
+	(void)o;
+	memset(c8->SCREEN, 0, sizeof(c8->SCREEN));
+	touch(c8, 0, c8->hires ? 64 : 32);
+}
+
+static void op_00ee(struct chip8 *c8, const struct op *o){ /* return from a subroutine */
+	(void)o;
+	if(!c8->SP)
+		WARN("Stack underflow\n");
+	else
+		c8->PC=c8->STACK[--c8->SP];
+}
+
+static void op_00fb(struct chip8 *c8, const struct op *o){ /* scroll right 4 pixels */
+	(void)o;
+	unsigned height = c8->hires ? 64 : 32;
+	for(unsigned y=0 ; y<height ; y++){
+		uint64_t *row = c8->SCREEN[y];
+		if(c8->hires)
+			row[1] = row[1] >> 4 | row[0] << 60;
+		row[0] >>= 4;
+	}
+	touch(c8, 0, height);
+}
+
+static void op_00fc(struct chip8 *c8, const struct op *o){ /* scroll left 4 pixels */
+	(void)o;
+	unsigned height = c8->hires ? 64 : 32;
+	for(unsigned y=0 ; y<height ; y++){
+		uint64_t *row = c8->SCREEN[y];
+		row[0] = row[0] << 4 | (c8->hires ? row[1] >> 60 : 0);
+		row[1] <<= 4;
+	}
+	touch(c8, 0, height);
+}
+
+static void op_00fd(struct chip8 *c8, const struct op *o){ /* exit, here: stop */
+	(void)o;
+	c8->PC-=2;
+}
+
+static void resolution(struct chip8 *c8, int hires){
+	c8->hires = hires;
+	memset(c8->SCREEN, 0, sizeof(c8->SCREEN));
+	repaint(c8);
+	c8->rows_written = ~0ull;
+}
+
+static void op_00fe(struct chip8 *c8, const struct op *o){ /* 64x32 */
+	(void)o;
+	resolution(c8, 0);
+}
+
+static void op_00ff(struct chip8 *c8, const struct op *o){ /* 128x64 */
+	(void)o;
+	resolution(c8, 1);
+}
+
+static void op_0nnn(struct chip8 *c8, const struct op *o){ /* legacy machine routine call */
+	(void)c8;
+	WARN("Legacy machine routine call: %X\n", (unsigned) o->instr);
+}
+
+static void op_unknown(struct chip8 *c8, const struct op *o){
+	(void)c8;
+	WARN("Unknown instruction: %X\n", (unsigned) o->instr);
+}
+
+static void op_1nnn(struct chip8 *c8, const struct op *o){ /* jump */
+	c8->PC=o->nnn;
+}
+
+static void op_2nnn(struct chip8 *c8, const struct op *o){ /* call a subroutine */
+	if(c8->SP==STACK_SIZE)
+		WARN("Stack overflow\n");
+	else
+		c8->STACK[c8->SP++] = c8->PC;
+	c8->PC=o->nnn;
+}
+
+static void op_3xnn(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x] == o->nn)
+		c8->PC+=2;
+}
+
+static void op_4xnn(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x] != o->nn)
+		c8->PC+=2;
+}
+
+static void op_5xy0(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x] == c8->V[o->y])
+		c8->PC+=2;
+}
+
+static void op_6xnn(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] = o->nn;
+}
+
+static void op_7xnn(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] += o->nn;
+}
+
+static void op_8xy0(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] = c8->V[o->y];
+}
+
+static void op_8xy1(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] |= c8->V[o->y];
+}
+
+static void op_8xy2(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] &= c8->V[o->y];
+}
+
+static void op_8xy3(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] ^= c8->V[o->y];
+}
+
+static void op_8xy4(struct chip8 *c8, const struct op *o){
+	c8->V[0xf] = c8->V[o->x] + c8->V[o->y] > 0xff ? 1 : 0;
+	c8->V[o->x] += c8->V[o->y];
+}
+
+static void op_8xy5(struct chip8 *c8, const struct op *o){
+	c8->V[0xf] = c8->V[o->x] > c8->V[o->y] ? 1 : 0;
+	c8->V[o->x] -= c8->V[o->y];
+}
+
+static void op_8xy6(struct chip8 *c8, const struct op *o){
+	c8->V[0xf] = c8->V[o->x]&1u;
+	c8->V[o->x] >>= 1u;
+}
+
+static void op_8xy7(struct chip8 *c8, const struct op *o){
+	c8->V[0xf] = c8->V[o->x] < c8->V[o->y] ? 1 : 0;
+	c8->V[o->x] = c8->V[o->y] - c8->V[o->x] ;
+}
+
+static void op_8xye(struct chip8 *c8, const struct op *o){
+	c8->V[0xf] = c8->V[o->x]>>7u;
+	c8->V[o->x] <<= 1u;
+}
+
+static void op_9xy0(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x] != c8->V[o->y])
+		c8->PC+=2;
+}
+
+static void op_annn(struct chip8 *c8, const struct op *o){
+	c8->I=o->nnn;
+}
+
+static void op_bnnn(struct chip8 *c8, const struct op *o){
+	c8->PC = o->nnn + c8->V[0];
+}
+
+static void op_cxnn(struct chip8 *c8, const struct op *o){
+	c8->V[o->x] = rand_r(&c8->seed) & o->nn;
+}
+
+int draw_sprite(uint64_t SCREEN[64][2], int hires, const unsigned char *sprite,
+		unsigned n, unsigned x, unsigned y){
+	uint64_t erased = 0;
+	unsigned rows = n ? n : 16;
+
+	if(!hires){
+		x %= 64;
+		for(unsigned i=0 ; i<rows ; i++){
+			/* the sprite byte at the top, rotated right to x */
+			uint64_t row = (uint64_t)sprite[i] << 56;
+			row = row >> x | row << (-x & 63);
+			uint64_t *screen = &SCREEN[(y+i)%32][0];
+			erased |= *screen & row;
+			*screen ^= row;
+		}
+		return erased != 0;
+	}
+
+	x %= 128;
+	for(unsigned i=0 ; i<rows ; i++){
+		/* the same across the two words of a row, 16 bits for n=0 */
+		uint64_t bits = n ? sprite[i] << 8 : sprite[2*i] << 8 | sprite[2*i+1];
+		uint64_t hi = bits << 48, lo = 0;
+		if(x & 64)
+			lo = hi, hi = 0;
+		unsigned s = x & 63;
+		if(s){
+			uint64_t h = hi >> s | lo << (64-s);
+			lo = lo >> s | hi << (64-s);
+			hi = h;
+		}
+		uint64_t *screen = SCREEN[(y+i)%64];
+		erased |= (screen[0] & hi) | (screen[1] & lo);
+		screen[0] ^= hi;
+		screen[1] ^= lo;
+	}
+	return erased != 0;
+}
+
+static void op_dxyn(struct chip8 *c8, const struct op *o){ /* display */
+	unsigned size = SPRITE_SIZE(o->n, c8->hires);
+	if(c8->I+size >= 0x1000){
+		WARN("Sprite data out of memory bounds: %X..%X\n",
+				(unsigned)c8->I, (unsigned)(c8->I+size));
+		return;
+	}
+
+	c8->sprites++;
+	c8->V[0xf] = 0; /* before reading VX and VY, which may be VF */
+	unsigned y = c8->V[o->y] % (c8->hires ? 64 : 32);
+	c8->V[0xf] = draw_sprite(c8->SCREEN, c8->hires, &c8->RAM[c8->I], o->n,
+			c8->V[o->x], y);
+	touch(c8, y, o->n ? o->n : 16);
+}
+
+static void op_ex9e(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x] > 16)
+		WARN("Unknown key: %u\n", (unsigned)c8->V[o->x]);
+	if(c8->KEYBOARD & 1<<(c8->V[o->x]))
+		c8->PC+=2;
+}
+
+static void op_exa1(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x] > 16)
+		WARN("Unknown key: %u\n", (unsigned)c8->V[o->x]);
+	if(!(c8->KEYBOARD & 1<<(c8->V[o->x])))
+		c8->PC+=2;
+}
+
+static void op_fx07(struct chip8 *c8, const struct op *o){
+	c8->V[o->x]=c8->DT;
+}
+
+static void op_fx0a(struct chip8 *c8, const struct op *o){
+	if(!c8->KEYBOARD)
+		c8->PC-=2;
+	else {
+		c8->V[o->x]=0;
+		for(unsigned short k=c8->KEYBOARD;!(k&1);k>>=1)
+			c8->V[o->x]++;
+	}
+}
+
+static void op_fx15(struct chip8 *c8, const struct op *o){
+	c8->DT=c8->V[o->x];
+}
+
+static void op_fx18(struct chip8 *c8, const struct op *o){
+	c8->ST=c8->V[o->x];
+}
+
+static void op_fx1e(struct chip8 *c8, const struct op *o){
+	c8->I+=c8->V[o->x];
+	/* Undocumented feature, reported on Wikipedia */
+	c8->V[0xf] = c8->I >= 0x1000 ? 1 : 0;
+	c8->I &= 0xfff;
+}
+
+static void op_fx29(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x]>0xF)
+		WARN("Too large input for a digit: %X\n", (unsigned)c8->V[o->x]);
+	else
+		c8->I = CHAR_SPRITES_OFFSET + 5*c8->V[o->x];
+}
+
+static void op_fx30(struct chip8 *c8, const struct op *o){
+	if(c8->V[o->x]>0xF)
+		WARN("Too large input for a digit: %X\n", (unsigned)c8->V[o->x]);
+	else
+		c8->I = BIG_SPRITES_OFFSET + 10*c8->V[o->x];
+}
+
+static void op_fx33(struct chip8 *c8, const struct op *o){
+	if(c8->I<0x200 || c8->I+3 >= 0x1000){
+		WARN("BCD store out of memory bounds: %X..%X\n",
+				(unsigned)c8->I, (unsigned)(c8->I+3));
+		return;
+	}
+
+	c8->RAM[c8->I+2] = c8->V[o->x]%10;
+	c8->RAM[c8->I+1] = (c8->V[o->x]/10)%10;
+	c8->RAM[c8->I]   = (c8->V[o->x]/100)%10;
+	invalidate(c8, c8->I, 3);
+}
+
+static void op_fx55(struct chip8 *c8, const struct op *o){
+	if(c8->I<0x200 || c8->I+o->x >= 0x1000){
+		WARN("Register store out of memory bounds: %X..%X\n",
+				(unsigned)c8->I, (unsigned)(c8->I+o->x));
+		return;
+	}
+
+	for(unsigned i=0 ; i<=o->x ; i++)
+		c8->RAM[c8->I+i] = c8->V[i];
+	invalidate(c8, c8->I, o->x+1);
+}
+
+static void op_fx65(struct chip8 *c8, const struct op *o){
+	if(c8->I+o->x >= 0x1000){
+		WARN("Register load out of memory bounds: %X..%X\n",
+				(unsigned)c8->I, (unsigned)(c8->I+o->x));
+		return;
+	}
+
+	for(unsigned i=0 ; i<=o->x ; i++)
+		c8->V[i] = c8->RAM[c8->I+i];
+}
+
+static void op_fx75(struct chip8 *c8, const struct op *o){
+	if(o->x >= sizeof(c8->RPL)){
+		WARN("Too many flag registers: %X\n", (unsigned)o->x);
+		return;
+	}
+	memcpy(c8->RPL, c8->V, o->x+1);
+}
+
+static void op_fx85(struct chip8 *c8, const struct op *o){
+	if(o->x >= sizeof(c8->RPL)){
+		WARN("Too many flag registers: %X\n", (unsigned)o->x);
+		return;
+	}
+	memcpy(c8->V, c8->RPL, o->x+1);
+}
+
+static struct op operands(const unsigned char instr[2]){
+	return (struct op){
+		.id = OP_unknown,
+		.instr = I_SHORT(instr),
+		.nnn = I_NNN(instr),
+		.x = I_X(instr),
+		.y = I_Y(instr),
+		.n = I_N(instr),
+		.nn = I_NN(instr),
+	};
+}
+
+struct op decode(const unsigned char instr[2]){
+	struct op o = operands(instr);
+
+	switch(I_CLASS(instr)){
+		case 0:
+			switch(I_SHORT(instr)){
+				case 0x00E0: o.id = OP_00e0; break;
+				case 0x00EE: o.id = OP_00ee; break;
+				case 0x00FB: o.id = OP_00fb; break;
+				case 0x00FC: o.id = OP_00fc; break;
+				case 0x00FD: o.id = OP_00fd; break;
+				case 0x00FE: o.id = OP_00fe; break;
+				case 0x00FF: o.id = OP_00ff; break;
+				default:
+					o.id = (I_SHORT(instr) & 0xFFF0) == 0x00C0 ? OP_00cn : OP_0nnn;
+					break;
+			}
+			break;
+		case 1: o.id = OP_1nnn; break;
+		case 2: o.id = OP_2nnn; break;
+		case 3: o.id = OP_3xnn; break;
+		case 4: o.id = OP_4xnn; break;
+		case 5: o.id = OP_5xy0; break;
+		case 6: o.id = OP_6xnn; break;
+		case 7: o.id = OP_7xnn; break;
+		case 8:
+			switch(I_N(instr)){
+				case 0:   o.id = OP_8xy0; break;
+				case 1:   o.id = OP_8xy1; break;
+				case 2:   o.id = OP_8xy2; break;
+				case 3:   o.id = OP_8xy3; break;
+				case 4:   o.id = OP_8xy4; break;
+				case 5:   o.id = OP_8xy5; break;
+				case 6:   o.id = OP_8xy6; break;
+				case 7:   o.id = OP_8xy7; break;
+				case 0xE: o.id = OP_8xye; break;
+			}
+			break;
+		case 9:   o.id = OP_9xy0; break;
+		case 0xA: o.id = OP_annn; break;
+		case 0xB: o.id = OP_bnnn; break;
+		case 0xC: o.id = OP_cxnn; break;
+		case 0xD: o.id = OP_dxyn; break;
+		case 0xE:
+			switch(I_NN(instr)){
+				case 0x9E: o.id = OP_ex9e; break;
+				case 0xA1: o.id = OP_exa1; break;
+			}
+			break;
+		case 0xF:
+			switch(I_NN(instr)){
+				case 0x07: o.id = OP_fx07; break;
+				case 0x0A: o.id = OP_fx0a; break;
+				case 0x15: o.id = OP_fx15; break;
+				case 0x18: o.id = OP_fx18; break;
+				case 0x1E: o.id = OP_fx1e; break;
+				case 0x29: o.id = OP_fx29; break;
+				case 0x30: o.id = OP_fx30; break;
+				case 0x33: o.id = OP_fx33; break;
+				case 0x55: o.id = OP_fx55; break;
+				case 0x65: o.id = OP_fx65; break;
+				case 0x75: o.id = OP_fx75; break;
+				case 0x85: o.id = OP_fx85; break;
+			}
+			break;
+	}
+
+	return o;
+}
+
+static int pc_ok(struct chip8 *c8){
+	if(c8->PC < 0x200 || c8->PC >= 0x1000){
+		WARN("PC out of usable adress space: %X\n", (unsigned) c8->PC);
+		return 0; /*TODO: abort? */
+	}
+	return 1;
+}
+
+/*
+ * Execution engines: each runs n instructions with the exact same semantics,
+ * they only differ in how instructions get decoded and dispatched.
+ */
+
+/* decode on every fetch, then switch on the instruction form */
+static void run_switch(struct chip8 *c8, unsigned long n){
+	for( ; n ; n--){
+		if(!pc_ok(c8))
+			continue;
+
+		unsigned short pc = c8->PC;
+		struct op o = decode(&c8->RAM[pc]);
+		c8->PC+=2;
+		switch(o.id){
+#define X(form) case OP_##form: op_##form(c8, &o); break;
+			OPCODES(X)
+#undef X
+		}
+		TRACE(c8, pc, o.instr, 1);
+		PROFILE(o.id, 1);
+	}
+}
+
+static void (*const handlers[])(struct chip8 *, const struct op *) = {
+#define X(form) [OP_##form] = op_##form,
+	OPCODES(X)
+#undef X
+};
+
+/* predecoded, call through the handler pointer */
+void step(struct chip8 *c8){
+	if(!pc_ok(c8))
+		return;
+
+	struct op odd, *op;
+	/* odd addresses straddle two entries, don't cache them */
+	op = c8->PC&1 ? &odd : &c8->OPS[c8->PC/2];
+	if(c8->PC&1 || !op->h.exec){
+		*op = decode(&c8->RAM[c8->PC]);
+		op->h.exec = handlers[op->id];
+	}
+	unsigned short pc = c8->PC;
+	c8->PC+=2;
+	op->h.exec(c8, op);
+	TRACE(c8, pc, op->instr, 1);
+	PROFILE(op->id, 1);
+}
+
+static void run_call(struct chip8 *c8, unsigned long n){
+	while(n--)
+		step(c8);
+}
+
+#ifdef __GNUC__
+/* predecoded, direct threading through computed gotos */
+static void run_threaded(struct chip8 *c8, unsigned long n){
+	static const void *const labels[] = {
+#define X(form) [OP_##form] = &&l_##form,
+		OPCODES(X)
+#undef X
+	};
+	struct op odd, *op;
+	unsigned short pc;
+
+#define DISPATCH() \
+	for(;;){ \
+		if(!n--) \
+			return; \
+		if(!pc_ok(c8)) \
+			continue; \
+		pc = c8->PC; \
+		op = pc&1 ? &odd : &c8->OPS[pc/2]; \
+		if(pc&1 || !op->h.label){ \
+			*op = decode(&c8->RAM[pc]); \
+			op->h.label = labels[op->id]; \
+		} \
+		c8->PC+=2; \
+		goto *op->h.label; \
+	}
+
+	DISPATCH();
+#define X(form) l_##form: op_##form(c8, op); \
+	TRACE(c8, pc, op->instr, 1); PROFILE(OP_##form, 1); DISPATCH();
+	OPCODES(X)
+#undef X
+#undef DISPATCH
+}
+#endif
+
+/* flat opcode to handler table, operands extracted by the handler */
+#define X(form) \
+static void t_##form(struct chip8 *c8, unsigned short instr){ \
+	const unsigned char b[2] = {instr>>8, instr&0xff}; \
+	struct op o = operands(b); \
+	op_##form(c8, &o); \
+	PROFILE(OP_##form, 1); \
+}
+OPCODES(X)
+#undef X
+
+static void (*TABLE[0x10000])(struct chip8 *, unsigned short);
+
+static void table_init(void){
+	static void (*const t_handlers[])(struct chip8 *, unsigned short) = {
+#define X(form) [OP_##form] = t_##form,
+		OPCODES(X)
+#undef X
+	};
+	for(unsigned i=0 ; i<0x10000 ; i++){
+		const unsigned char b[2] = {i>>8, i&0xff};
+		TABLE[i] = t_handlers[decode(b).id];
+	}
+}
+
+static void run_table(struct chip8 *c8, unsigned long n){
+	while(n--){
+		if(!pc_ok(c8))
+			continue;
+
+		unsigned short pc = c8->PC;
+		unsigned short instr = c8->RAM[pc]<<8 | c8->RAM[pc+1];
+		c8->PC+=2;
+		TABLE[instr](c8, instr);
+		TRACE(c8, pc, instr, 1);
+	}
+}
+
+const struct engine engines[] = {
+	{"switch", run_switch, NULL},
+	{"call", run_call, NULL},
+#ifdef __GNUC__
+	{"threaded", run_threaded, NULL},
+#endif
+	{"table", run_table, table_init},
+#ifdef __x86_64__
+	{"jit", run_jit, NULL},
+#endif
+	{0}
+};
+
+const struct engine *find_engine(const char *name){
+	for(const struct engine *e=engines ; e->name ; e++){
+		if(!strcmp(e->name, name)){
+			if(e->init)
+				e->init();
+			return e;
+		}
+	}
+	return NULL;
+}
+
+void reset(struct chip8 *c8, const unsigned char *rom, size_t size){
+	memset(c8->RAM, 0, sizeof(c8->RAM));
+	memcpy(c8->RAM+CHAR_SPRITES_OFFSET, char_sprites, sizeof(char_sprites));
+	memcpy(c8->RAM+BIG_SPRITES_OFFSET, big_sprites, sizeof(big_sprites));
+	if(size > sizeof(c8->RAM)-0x200)
+		size = sizeof(c8->RAM)-0x200;
+	memcpy(c8->RAM+0x200, rom, size);
+
+	memset(c8->V, 0, sizeof(c8->V));
+	c8->I=0;
+	c8->DT=c8->ST=0;
+	c8->PC=0x200;
+	c8->SP=0;
+	memset(c8->STACK, 0, sizeof(c8->STACK));
+	c8->KEYBOARD=0;
+	memset(c8->SCREEN, 0, sizeof(c8->SCREEN));
+	c8->hires=0;
+	repaint(c8);
+	c8->seed=1;
+	memset(c8->RPL, 0, sizeof(c8->RPL));
+	c8->idle=0;
+	c8->sprites=0;
+	c8->idle_wait=c8->idle_backoff=0;
+	c8->ram_written=c8->rows_written=~0ull;
+
+	memset(c8->OPS, 0, sizeof(c8->OPS));
+#ifdef __x86_64__
+	jit_flush(c8);
+#endif
+}
+
+void restore(struct chip8 *c8, const void *state){
+	const unsigned char *RAM = state;
+
+	/* only code that differs needs decoding again */
+	for(unsigned a=0 ; a<sizeof(c8->RAM) ; a+=64)
+		if(memcmp(c8->RAM+a, RAM+a, 64))
+			invalidate(c8, a, 64);
+	memcpy(c8, state, STATE_SIZE);
+	repaint(c8);
+	c8->ram_written = c8->rows_written = ~0ull;
+}
+
+void release(struct chip8 *c8){
+#ifdef __x86_64__
+	jit_free(c8);
+#endif
+	(void)c8;
+}
+
+/*
+ * Idle loops: when the instructions from PC lead back to PC with the same
+ * registers, touching nothing but V and I, the machine spins until DT or
+ * the keys change, and those only change between run() calls. The first
+ * trip may still settle a register (FX07 reading a DT that just ticked),
+ * so the state is compared between the first and the second return to PC.
+ * Only the forms that show up in polling loops are followed, straight
+ * from RAM: looking must cost less than the few instructions it saves.
+ */
+#define IDLE_MAX 8
+#define IDLE_BACKOFF 32
+
+struct idle {
+	unsigned char V[16];
+	unsigned short I, PC;
+};
+
+/* execute one polling loop instruction on s, 0 for anything else */
+static int idle_step(const struct chip8 *c8, struct idle *s){
+	if(s->PC < 0x200 || s->PC >= 0x1000-1)
+		return 0;
+
+	const unsigned char *instr = &c8->RAM[s->PC];
+	unsigned char *VX = &s->V[I_X(instr)];
+	unsigned char VY = s->V[I_Y(instr)];
+	s->PC += 2;
+	switch(I_CLASS(instr)){
+		case 0x1: s->PC = I_NNN(instr); return 1;
+		case 0x3: if(*VX == I_NN(instr)) s->PC+=2; return 1;
+		case 0x4: if(*VX != I_NN(instr)) s->PC+=2; return 1;
+		case 0x5: if(*VX == VY) s->PC+=2; return I_N(instr) == 0;
+		case 0x9: if(*VX != VY) s->PC+=2; return I_N(instr) == 0;
+		case 0x6: *VX = I_NN(instr); return 1;
+		case 0x8: *VX = VY; return I_N(instr) == 0;
+		case 0xA: s->I = I_NNN(instr); return 1;
+		case 0xE:
+			if(*VX > 0xf) /* leave the warning to the engine */
+				return 0;
+			if(I_NN(instr) == 0x9E && c8->KEYBOARD>>*VX & 1)
+				s->PC+=2;
+			if(I_NN(instr) == 0xA1 && !(c8->KEYBOARD>>*VX & 1))
+				s->PC+=2;
+			return I_NN(instr) == 0x9E || I_NN(instr) == 0xA1;
+		case 0xF:
+			if(I_NN(instr) == 0x07)
+				*VX = c8->DT;
+			else if(I_NN(instr) == 0x0A && !c8->KEYBOARD)
+				s->PC-=2;
+			else
+				return 0;
+			return 1;
+	}
+	return 0;
+}
+
+static int idle_same(const struct idle *a, const struct idle *b){
+	return a->PC == b->PC && a->I == b->I && !memcmp(a->V, b->V, sizeof(a->V));
+}
+
+/* run n instructions of an idle loop, 0 if PC is not in one */
+static int idle_run(struct chip8 *c8, unsigned long n){
+	struct idle start, s, loop;
+	unsigned prefix = 0, len = 0;
+
+	memcpy(start.V, c8->V, sizeof(start.V));
+	start.I = c8->I;
+	start.PC = c8->PC;
+	s = loop = start;
+	for(unsigned i=1 ; i<=2*IDLE_MAX && !len ; i++){
+		if(!idle_step(c8, &s))
+			return 0;
+		if(s.PC != start.PC)
+			continue;
+		if(idle_same(&s, &loop))
+			len = i-prefix;
+		else if(prefix)
+			return 0;
+		else {
+			prefix = i;
+			loop = s;
+		}
+	}
+	if(!len || n <= prefix)
+		return 0;
+
+	/* every trip around brings it back to loop, only the rest matters */
+	s = loop;
+	for(n = (n-prefix)%len ; n ; n--)
+		idle_step(c8, &s);
+	memcpy(c8->V, s.V, sizeof(s.V));
+	c8->I = s.I;
+	c8->PC = s.PC;
+	return 1;
+}
+
+void run(struct chip8 *c8, unsigned long n){
+	unsigned short pc = c8->PC;
+
+	if(c8->hits || c8->calls){
+		for( ; n ; n--){
+			if(c8->hits && c8->PC < 0x1000)
+				c8->hits[c8->PC]++;
+			step(c8);
+			if(c8->calls)
+				callgraph_step(c8->calls, c8);
+		}
+		return;
+	}
+
+	if(c8->busy || !n)
+		;
+	else if(c8->idle_wait)
+		c8->idle_wait--;
+	else if(idle_run(c8, n)){
+		/* one record for the whole loop */
+		TRACE(c8, pc, c8->RAM[pc]<<8 | c8->RAM[pc+1], n);
+		PROFILE(PROF_IDLE, n);
+		c8->idle += n;
+		c8->idle_backoff = 0;
+		return;
+	} else {
+		/* not idle, look less and less often while it stays that way */
+		c8->idle_backoff = c8->idle_backoff ? 2*c8->idle_backoff : 1;
+		if(c8->idle_backoff > IDLE_BACKOFF)
+			c8->idle_backoff = IDLE_BACKOFF;
+		c8->idle_wait = c8->idle_backoff;
+	}
+	c8->engine->run(c8, n);
+}
+
+unsigned long long fnv1a(const void *p, size_t n){
+	const unsigned char *b = p;
+	unsigned long long h = 0xcbf29ce484222325ull;
+	while(n--){
+		h ^= *b++;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+void tick(struct chip8 *c8){
+	if(c8->DT)
+		c8->DT--;
+	if(c8->ST)
+		c8->ST--;
+}
@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "diff.h"
+#include "hotspots.h"
+#include "lockstep.h"
+#include "rewind.h"
+
+#define REFERENCE "switch"
+/* small, so that it wraps every few dozen frames */
+#define REWIND_RING 3000
+
+/* hold a random key (or none) for 16 frames, like lockstep() */
+static unsigned short keys(unsigned long frame, unsigned *seed, unsigned short held){
+	if(frame%16)
+		return held;
+	unsigned key = rand_r(seed)%17;
+	return key < 16 ? 1u<<key : 0;
+}
+
+#define FIELD(name, fmt, a, b) \
+	if((a) != (b)) \
+		printf("  %-10s " fmt " (reference) " fmt " (%s)\n", name, a, b, engine);
+
+/* print every part of the state that differs */
+static void report(const struct chip8 *ref, const struct chip8 *c8, const char *engine){
+	char name[16];
+	for(int r=0 ; r<16 ; r++){
+		snprintf(name, sizeof(name), "V%X", r);
+		FIELD(name, "%02X", (unsigned)ref->V[r], (unsigned)c8->V[r]);
+	}
+	FIELD("I", "%03X", (unsigned)ref->I, (unsigned)c8->I);
+	FIELD("PC", "%03X", (unsigned)ref->PC, (unsigned)c8->PC);
+	FIELD("SP", "%u", (unsigned)ref->SP, (unsigned)c8->SP);
+	FIELD("DT", "%u", (unsigned)ref->DT, (unsigned)c8->DT);
+	FIELD("ST", "%u", (unsigned)ref->ST, (unsigned)c8->ST);
+	FIELD("KEYBOARD", "%04X", (unsigned)ref->KEYBOARD, (unsigned)c8->KEYBOARD);
+	FIELD("seed", "%08X", ref->seed, c8->seed);
+	for(int s=0 ; s<STACK_SIZE ; s++){
+		snprintf(name, sizeof(name), "STACK[%d]", s);
+		FIELD(name, "%03X", (unsigned)ref->STACK[s], (unsigned)c8->STACK[s]);
+	}
+
+	FIELD("hires", "%u", (unsigned)ref->hires, (unsigned)c8->hires);
+	for(int r=0 ; r<8 ; r++){
+		snprintf(name, sizeof(name), "RPL%X", r);
+		FIELD(name, "%02X", (unsigned)ref->RPL[r], (unsigned)c8->RPL[r]);
+	}
+
+	unsigned count = 0, first = 0;
+	for(unsigned y=64 ; y-- ; )
+		if(memcmp(ref->SCREEN[y], c8->SCREEN[y], sizeof(ref->SCREEN[y])))
+			count++, first = y;
+	if(count)
+		printf("  SCREEN     %u rows differ, first y=%u: %016llx%016llx (reference) %016llx%016llx (%s)\n",
+				count, first,
+				(unsigned long long)ref->SCREEN[first][0], (unsigned long long)ref->SCREEN[first][1],
+				(unsigned long long)c8->SCREEN[first][0], (unsigned long long)c8->SCREEN[first][1],
+				engine);
+
+	count = 0;
+	for(unsigned a=sizeof(ref->RAM) ; a-- ; )
+		if(ref->RAM[a] != c8->RAM[a])
+			count++, first = a;
+	if(count)
+		printf("  RAM        %u bytes differ, first at %03X: %02X (reference) %02X (%s)\n",
+				count, first, (unsigned)ref->RAM[first], (unsigned)c8->RAM[first], engine);
+}
+
+static int same(const struct chip8 *a, const struct chip8 *b){
+	return !memcmp(a, b, STATE_SIZE);
+}
+
+/* find the instruction where ref and c8, equal at state, part */
+static void pinpoint(struct chip8 *ref, struct chip8 *c8, const unsigned char *state,
+		unsigned long instructions, unsigned n){
+	restore(ref, state);
+	restore(c8, state);
+	for(unsigned i=0 ; i<n ; i++){
+		unsigned short pc = ref->PC;
+		char text[32] = "(bad PC)";
+		if(pc < 0x1000-1)
+			disassemble(&ref->RAM[pc], text, sizeof(text));
+
+		run(ref, 1);
+		run(c8, 1);
+		if(!same(ref, c8)){
+			printf("mismatch after %lu instructions, at %03X: %02X%02X %s\n",
+					instructions+i+1, (unsigned)pc,
+					(unsigned)ref->RAM[pc&0xfff], (unsigned)ref->RAM[(pc+1)&0xfff], text);
+			report(ref, c8, c8->engine->name);
+			return;
+		}
+	}
+	/* only together, an idle loop skip over the whole stretch */
+	printf("mismatch after %lu instructions, run %u at a time\n", instructions+n, n);
+	report(ref, c8, c8->engine->name);
+}
+
+static int diff_engine(const struct engine *e, const unsigned char *rom, size_t size,
+		unsigned long frames, unsigned every, int busy){
+	struct chip8 *ref = calloc(1, sizeof(*ref));
+	struct chip8 *c8 = calloc(1, sizeof(*c8));
+	unsigned char *state = malloc(STATE_SIZE);
+	if(!ref || !c8 || !state){
+		perror("diff");
+		free(ref), free(c8), free(state);
+		return 2;
+	}
+
+	ref->engine = find_engine(REFERENCE);
+	ref->busy = 1;
+	reset(ref, rom, size);
+	c8->engine = e;
+	c8->busy = busy;
+	reset(c8, rom, size);
+
+	int status = 0;
+	unsigned input = 1;
+	unsigned long instructions = 0;
+	for(unsigned long f=0 ; f<frames && !status ; f++){
+		ref->KEYBOARD = c8->KEYBOARD = keys(f, &input, ref->KEYBOARD);
+		for(unsigned done=0 ; done<FREQ/60 && !status ; ){
+			unsigned n = FREQ/60-done < every ? FREQ/60-done : every;
+			memcpy(state, ref, STATE_SIZE);
+			run(ref, n);
+			run(c8, n);
+			if(!same(ref, c8)){
+				pinpoint(ref, c8, state, instructions, n);
+				status = 1;
+			}
+			done += n;
+			instructions += n;
+		}
+		tick(ref);
+		tick(c8);
+	}
+
+	release(ref);
+	release(c8);
+	free(ref), free(c8), free(state);
+	return status;
+}
+
+/* every lane against its own reference, with lockstep()'s keys */
+static int diff_lockstep(const unsigned char *rom, size_t size, unsigned long frames){
+	struct lanes *l = aligned_alloc(_Alignof(struct lanes), sizeof(*l));
+	struct chip8 *ref = calloc(LANES, sizeof(*ref));
+	struct chip8 *c8 = malloc(sizeof(*c8));
+	if(!l || !ref || !c8){
+		perror("diff");
+		free(l), free(ref), free(c8);
+		return 2;
+	}
+
+	lanes_reset(l, LANES, 1, rom, size);
+	unsigned input[LANES];
+	for(unsigned k=0 ; k<LANES ; k++){
+		ref[k].engine = find_engine(REFERENCE);
+		ref[k].busy = 1;
+		reset(&ref[k], rom, size);
+		ref[k].seed = 1+k;
+		input[k] = k;
+	}
+
+	int status = 0;
+	for(unsigned long f=0 ; f<frames && !status ; f++){
+		for(unsigned k=0 ; k<LANES ; k++){
+			unsigned short held = keys(f, &input[k], ref[k].KEYBOARD);
+			ref[k].KEYBOARD = l->lane[k].KEYBOARD = held;
+			run(&ref[k], FREQ/60);
+			tick(&ref[k]);
+		}
+		lanes_frame(l);
+
+		for(unsigned k=0 ; k<LANES && !status ; k++){
+			lanes_get(l, k, c8);
+			if(!same(&ref[k], c8)){
+				printf("mismatch in lane %u after frame %lu\n", k, f+1);
+				report(&ref[k], c8, "lockstep");
+				status = 1;
+			}
+		}
+	}
+
+	for(unsigned k=0 ; k<LANES ; k++)
+		release(&ref[k]);
+	free(l), free(ref), free(c8);
+	return status;
+}
+
+/*
+ * Rewind on a small ring against whole copies of every snapshot: random
+ * stretches of stepping back, and of frames where nothing runs so that
+ * empty deltas get recorded too. One snapshot per frame.
+ */
+static int diff_rewind(const unsigned char *rom, size_t size, unsigned long frames){
+	struct history *h = history_new(REWIND_RING, 1);
+	unsigned char *snapshots = malloc((frames+1)*STATE_SIZE);
+	struct chip8 *c8 = calloc(1, sizeof(*c8));
+	struct chip8 *want = calloc(1, sizeof(*want));
+	if(!h || !snapshots || !c8 || !want){
+		perror("diff");
+		history_free(h);
+		free(snapshots), free(c8), free(want);
+		return 2;
+	}
+
+	c8->engine = find_engine(REFERENCE);
+	c8->busy = 1;
+	reset(c8, rom, size);
+
+	int status = 0;
+	unsigned input = 1, plan = 2;
+	unsigned back = 0, still = 0;
+	size_t n = 0; /* snapshots the history should still have */
+	for(unsigned long f=0 ; f<frames && !status ; f++){
+		if(!back && !still && n > 1){
+			unsigned r = rand_r(&plan)%32;
+			if(r == 0)
+				back = 1 + rand_r(&plan)%64;
+			else if(r == 1)
+				still = 1 + rand_r(&plan)%8;
+		}
+
+		if(back){
+			back--;
+			if(!history_back(h, c8)){
+				back = 0;
+				continue;
+			}
+			n--;
+			memcpy(want, snapshots + (n-1)*STATE_SIZE, STATE_SIZE);
+			if(!same(want, c8)){
+				printf("mismatch stepping back after frame %lu, to snapshot %zu\n", f+1, n-1);
+				report(want, c8, "rewind");
+				status = 1;
+			}
+			continue;
+		}
+
+		c8->KEYBOARD = keys(f, &input, c8->KEYBOARD);
+		if(still)
+			still--;
+		else {
+			run(c8, FREQ/60);
+			tick(c8);
+		}
+		history_frame(h, c8);
+		memcpy(snapshots + n++*STATE_SIZE, c8, STATE_SIZE);
+	}
+
+	history_free(h);
+	release(c8);
+	free(snapshots), free(c8), free(want);
+	return status;
+}
+
+int diff(const char *name, const unsigned char *rom, size_t size,
+		unsigned long frames, unsigned every, int busy){
+	if(!strcmp(name, "lockstep"))
+		return diff_lockstep(rom, size, frames);
+	if(!strcmp(name, "rewind"))
+		return diff_rewind(rom, size, frames);
+
+	const struct engine *e = find_engine(name);
+	if(!e){
+		fprintf(stderr, "Unknown engine: %s\n", name);
+		return 2;
+	}
+	return diff_engine(e, rom, size, frames, every ? every : 1, busy);
+}
+
+/* instruction templates, random bits where the mask is set */
+static const struct {
+	unsigned short bits, mask;
+	unsigned weight;
+} forms[] = {
+	{0x00E0, 0x0000, 1}, {0x00EE, 0x0000, 2}, {0x1000, 0x0FFF, 2},
+	{0x2000, 0x0FFF, 2}, {0x3000, 0x0FFF, 2}, {0x4000, 0x0FFF, 2},
+	{0x5000, 0x0FF0, 2}, {0x6000, 0x0FFF, 4}, {0x7000, 0x0FFF, 4},
+	{0x8000, 0x0FF0, 2}, {0x8001, 0x0FF0, 2}, {0x8002, 0x0FF0, 2},
+	{0x8003, 0x0FF0, 2}, {0x8004, 0x0FF0, 2}, {0x8005, 0x0FF0, 2},
+	{0x8006, 0x0FF0, 2}, {0x8007, 0x0FF0, 2}, {0x800E, 0x0FF0, 2},
+	{0x9000, 0x0FF0, 2}, {0xA000, 0x0FFF, 3}, {0xB000, 0x0FFF, 1},
+	{0xC000, 0x0FFF, 2}, {0xD000, 0x0FFF, 2}, {0xE09E, 0x0F00, 1},
+	{0xE0A1, 0x0F00, 1}, {0xF007, 0x0F00, 1}, {0xF00A, 0x0F00, 1},
+	{0xF015, 0x0F00, 1}, {0xF018, 0x0F00, 1}, {0xF01E, 0x0F00, 1},
+	{0xF029, 0x0F00, 1}, {0xF033, 0x0F00, 1}, {0xF055, 0x0F00, 1},
+	{0xF065, 0x0F00, 1}, {0x0000, 0xFFFF, 1}, /* anything at all */
+	/* SCHIP, but not 00FD which stops the machine */
+	{0x00C0, 0x000F, 1}, {0x00FB, 0x0000, 1}, {0x00FC, 0x0000, 1},
+	{0x00FE, 0x0000, 1}, {0x00FF, 0x0000, 1}, {0xF030, 0x0F00, 1},
+	{0xF075, 0x0700, 1}, {0xF085, 0x0700, 1},
+};
+
+void random_rom(unsigned char *rom, size_t size, unsigned seed){
+	unsigned total = 0;
+	for(size_t i=0 ; i<sizeof(forms)/sizeof(*forms) ; i++)
+		total += forms[i].weight;
+
+	for(size_t a=0 ; a+1<size ; a+=2){
+		unsigned pick = rand_r(&seed)%total, i = 0;
+		while(pick >= forms[i].weight)
+			pick -= forms[i++].weight;
+
+		unsigned short instr = forms[i].bits | (rand_r(&seed) & forms[i].mask);
+		/* keep jumps and calls on instructions of the ROM */
+		if(forms[i].mask == 0x0FFF && (instr>>12 == 1 || instr>>12 == 2))
+			instr = (instr & 0xF000) | (0x200 + rand_r(&seed)%(size/2)*2);
+		rom[a] = instr>>8;
+		rom[a+1] = instr;
+	}
+}
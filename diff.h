@@ -0,0 +1,29 @@
+#ifndef C8_DIFF_H
+#define C8_DIFF_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/*
+ * Differential testing against the reference: the switch engine, which
+ * decodes every instruction as it fetches it, without idle loop skipping,
+ * so predecoding bugs can't hide on both sides. The ROM runs on both side by
+ * side with the same random key presses, and the whole machine state is
+ * compared every `every` instructions. On a mismatch the last stretch is
+ * replayed one instruction at a time and the first instruction that
+ * differs is reported with the state that differs, on stdout.
+ *
+ * name is an engine, or "lockstep" to check every lane of a lockstep run
+ * against its own reference once per frame, or "rewind" to step back
+ * through a small rewind ring, wrapping around, and check every restored
+ * snapshot against a copy. busy turns off idle loop skipping for the
+ * engine as well. 0 if all matched, 1 on a mismatch.
+ */
+int diff(const char *name, const unsigned char *rom, size_t size,
+		unsigned long frames, unsigned every, int busy);
+
+/* size bytes of random instructions, mostly valid, jumps stay in the ROM */
+void random_rom(unsigned char *rom, size_t size, unsigned seed);
+
+#endif /* C8_DIFF_H */
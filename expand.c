@@ -0,0 +1,92 @@
+#include <string.h>
+
+#include "expand.h"
+
+/* same as in lockstep.c */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD
+#endif
+
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+typedef unsigned char v16u8 __attribute__((vector_size(16)));
+
+#define ONES 0x0101010101010101ull
+
+/* bit 7-k of a byte in byte k of a word, as laid out in memory */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PICK 0x0102040810204080ull
+#else
+#define PICK 0x8040201008040201ull
+#endif
+
+/*
+ * All 64 pixels as bytes, eight per lane: each lane takes one byte of the
+ * row, copies it to all of its bytes and keeps a different bit in each,
+ * then turns every nonzero byte into 0xff. No carry crosses a byte: each
+ * holds a single bit, and 0x7f plus one bit is at most 0xff.
+ */
+static inline void bytes(unsigned char dst[64], uint64_t row){
+	for(int i=0 ; i<64 ; i+=32){
+		v4u64 shift = {56, 48, 40, 32};
+		v4u64 v = (row << i) >> shift & 0xff;
+		v |= v << 8;
+		v |= v << 16;
+		v |= v << 32;
+		v = ((v & PICK) + 0x7f*ONES) & 0x80*ONES;
+		v = (v << 1) - (v >> 7);
+		memcpy(dst+i, &v, sizeof(v));
+	}
+}
+
+/* 32 pixels as words, eight at a time against a copy of the half row */
+static inline void words(uint32_t dst[32], uint32_t half,
+		uint32_t on, uint32_t off){
+	const v8u32 bit = {1u<<31, 1u<<30, 1u<<29, 1u<<28,
+		1u<<27, 1u<<26, 1u<<25, 1u<<24};
+	for(int i=0 ; i<32 ; i+=8){
+		v8u32 m = (half << i) & bit;
+		m = -((m | -m) >> 31); /* not a compare, see lockstep.c */
+		v8u32 p = off ^ ((on ^ off) & m);
+		memcpy(dst+i, &p, sizeof(p));
+	}
+}
+
+SIMD void expand8(unsigned char *dst, uint64_t row, unsigned n){
+	unsigned char m[64];
+	if(n == 64){
+		bytes(dst, row);
+		return;
+	}
+	bytes(m, row);
+	memcpy(dst, m, n);
+}
+
+SIMD void expand32(uint32_t *dst, uint64_t row, unsigned n,
+		uint32_t on, uint32_t off){
+	uint32_t p[64];
+	if(n == 64){
+		words(dst, row>>32, on, off);
+		words(dst+32, row, on, off);
+		return;
+	}
+	words(p, row>>32, on, off);
+	words(p+32, row, on, off);
+	memcpy(dst, p, n*sizeof(*dst));
+}
+
+SIMD void expand_scaled(unsigned char *dst, uint64_t row, unsigned n,
+		unsigned scale){
+	unsigned char m[64];
+	bytes(m, row);
+
+	for(unsigned i=0 ; i<n ; i++, dst+=scale){
+		v16u8 p = (v16u8){0} + m[i];
+		unsigned k = 0;
+		for( ; k+16<=scale ; k+=16)
+			memcpy(dst+k, &p, 16);
+		memcpy(dst+k, &p, scale-k);
+	}
+}
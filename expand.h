@@ -0,0 +1,21 @@
+#ifndef C8_EXPAND_H
+#define C8_EXPAND_H
+
+#include <stdint.h>
+
+/*
+ * Bitplane to pixels for the media backends: the leftmost n pixels (up to
+ * 64) of a SCREEN row, the leftmost pixel in the top bit, written left to
+ * right. Built for AVX2 and for the baseline, picked at load time.
+ */
+
+/* one byte per pixel, 0xff where lit and 0 elsewhere */
+void expand8(unsigned char *dst, uint64_t row, unsigned n);
+/* one word per pixel, on where lit and off elsewhere */
+void expand32(uint32_t *dst, uint64_t row, unsigned n,
+		uint32_t on, uint32_t off);
+/* as expand8() with each pixel repeated scale times, n*scale bytes */
+void expand_scaled(unsigned char *dst, uint64_t row, unsigned n,
+		unsigned scale);
+
+#endif /* C8_EXPAND_H */
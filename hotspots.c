@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "hotspots.h"
+
+void disassemble(const unsigned char instr[2], char *buf, size_t size){
+	struct op o = decode(instr);
+	unsigned x = o.x, y = o.y, n = o.n, nn = o.nn, nnn = o.nnn;
+
+	switch(o.id){
+		case OP_00cn: snprintf(buf, size, "SCD %X", n); break;
+		case OP_00e0: snprintf(buf, size, "CLS"); break;
+		case OP_00ee: snprintf(buf, size, "RET"); break;
+		case OP_00fb: snprintf(buf, size, "SCR"); break;
+		case OP_00fc: snprintf(buf, size, "SCL"); break;
+		case OP_00fd: snprintf(buf, size, "EXIT"); break;
+		case OP_00fe: snprintf(buf, size, "LOW"); break;
+		case OP_00ff: snprintf(buf, size, "HIGH"); break;
+		case OP_0nnn: snprintf(buf, size, "SYS %03X", nnn); break;
+		case OP_1nnn: snprintf(buf, size, "JP %03X", nnn); break;
+		case OP_2nnn: snprintf(buf, size, "CALL %03X", nnn); break;
+		case OP_3xnn: snprintf(buf, size, "SE V%X, %02X", x, nn); break;
+		case OP_4xnn: snprintf(buf, size, "SNE V%X, %02X", x, nn); break;
+		case OP_5xy0: snprintf(buf, size, "SE V%X, V%X", x, y); break;
+		case OP_6xnn: snprintf(buf, size, "LD V%X, %02X", x, nn); break;
+		case OP_7xnn: snprintf(buf, size, "ADD V%X, %02X", x, nn); break;
+		case OP_8xy0: snprintf(buf, size, "LD V%X, V%X", x, y); break;
+		case OP_8xy1: snprintf(buf, size, "OR V%X, V%X", x, y); break;
+		case OP_8xy2: snprintf(buf, size, "AND V%X, V%X", x, y); break;
+		case OP_8xy3: snprintf(buf, size, "XOR V%X, V%X", x, y); break;
+		case OP_8xy4: snprintf(buf, size, "ADD V%X, V%X", x, y); break;
+		case OP_8xy5: snprintf(buf, size, "SUB V%X, V%X", x, y); break;
+		case OP_8xy6: snprintf(buf, size, "SHR V%X, V%X", x, y); break;
+		case OP_8xy7: snprintf(buf, size, "SUBN V%X, V%X", x, y); break;
+		case OP_8xye: snprintf(buf, size, "SHL V%X, V%X", x, y); break;
+		case OP_9xy0: snprintf(buf, size, "SNE V%X, V%X", x, y); break;
+		case OP_annn: snprintf(buf, size, "LD I, %03X", nnn); break;
+		case OP_bnnn: snprintf(buf, size, "JP V0, %03X", nnn); break;
+		case OP_cxnn: snprintf(buf, size, "RND V%X, %02X", x, nn); break;
+		case OP_dxyn: snprintf(buf, size, "DRW V%X, V%X, %X", x, y, n); break;
+		case OP_ex9e: snprintf(buf, size, "SKP V%X", x); break;
+		case OP_exa1: snprintf(buf, size, "SKNP V%X", x); break;
+		case OP_fx07: snprintf(buf, size, "LD V%X, DT", x); break;
+		case OP_fx0a: snprintf(buf, size, "LD V%X, K", x); break;
+		case OP_fx15: snprintf(buf, size, "LD DT, V%X", x); break;
+		case OP_fx18: snprintf(buf, size, "LD ST, V%X", x); break;
+		case OP_fx1e: snprintf(buf, size, "ADD I, V%X", x); break;
+		case OP_fx29: snprintf(buf, size, "LD F, V%X", x); break;
+		case OP_fx30: snprintf(buf, size, "LD HF, V%X", x); break;
+		case OP_fx33: snprintf(buf, size, "LD B, V%X", x); break;
+		case OP_fx55: snprintf(buf, size, "LD [I], V%X", x); break;
+		case OP_fx65: snprintf(buf, size, "LD V%X, [I]", x); break;
+		case OP_fx75: snprintf(buf, size, "LD R, V%X", x); break;
+		case OP_fx85: snprintf(buf, size, "LD V%X, R", x); break;
+		default: snprintf(buf, size, "DW %04X", (unsigned)o.instr); break;
+	}
+}
+
+static const unsigned long long *counts;
+
+static int by_count(const void *a, const void *b){
+	unsigned long long ca = counts[*(const unsigned short *)a];
+	unsigned long long cb = counts[*(const unsigned short *)b];
+	if(ca != cb)
+		return ca < cb ? 1 : -1;
+	return *(const unsigned short *)a - *(const unsigned short *)b;
+}
+
+int write_hotspots(const struct chip8 *c8, const char *path){
+	unsigned short order[0x1000];
+	unsigned n = 0;
+	unsigned long long total = 0;
+	for(unsigned a=0x200 ; a<0x1000 ; a++){
+		if(!c8->hits[a])
+			continue;
+		order[n++] = a;
+		total += c8->hits[a];
+	}
+	counts = c8->hits;
+	qsort(order, n, sizeof(*order), by_count);
+
+	FILE *f = fopen(path, "w");
+	if(!f)
+		return -1;
+
+	fprintf(f, "# %llu instructions: address, count, share, running share, code\n", total);
+	unsigned long long sum = 0;
+	for(unsigned i=0 ; i<n ; i++){
+		unsigned a = order[i];
+		const unsigned char *instr = &c8->RAM[a];
+		char text[32];
+		if(a+1 < 0x1000)
+			disassemble(instr, text, sizeof(text));
+		else
+			snprintf(text, sizeof(text), "(last byte of RAM)");
+		sum += c8->hits[a];
+		fprintf(f, "%03X %14llu %6.2f%% %6.2f%%  %02X%02X  %s\n", a, c8->hits[a],
+				100.0*c8->hits[a]/total, 100.0*sum/total,
+				(unsigned)instr[0], a+1 < 0x1000 ? (unsigned)instr[1] : 0, text);
+	}
+
+	int err = ferror(f);
+	if(fclose(f) || err)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef C8_HOTSPOTS_H
+#define C8_HOTSPOTS_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/* assembly for one instruction, Cowgod's mnemonics */
+void disassemble(const unsigned char instr[2], char *buf, size_t size);
+
+/*
+ * Write c8->hits as a disassembly of every executed address, most executed
+ * first, with its share of all instructions. The instructions are read from
+ * RAM as it is now, code that modified itself shows its last version.
+ * 0 on success, -1 with errno set.
+ */
+int write_hotspots(const struct chip8 *c8, const char *path);
+
+#endif /* C8_HOTSPOTS_H */
@@ -0,0 +1,563 @@
+/*
+ * Basic block translation to x86-64.
+ *
+ * Straight-line runs of ALU instructions are translated to native code, a
+ * block ends at a jump or a skip (both translated) or before anything else
+ * (call, return, DXYN, keys, memory...) which is left to step().
+ * Guest registers are loaded in host registers on first use and stored back
+ * on block exit.
+ */
+#ifdef __x86_64__
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "chip8.h"
+#include "profile.h"
+#include "trace.h"
+
+#define CODE_SIZE (1<<20)
+#define MAX_BLOCK_LEN 64
+
+/*
+ * Worst case code size, in bytes. The longest instruction is 8XY7 with its
+ * budget check and three register loads, 54. Every instruction but the
+ * last also gets an exit stub storing the PC (9), all 11 pool registers
+ * (11*8), the count (5) and a jump (5); the last one gets the same stores
+ * and the pops and ret instead (113). The prologue is 13.
+ */
+#define MAX_INSN_CODE 64
+#define MAX_EXIT_CODE 128
+#define MAX_BLOCK_CODE (64 + MAX_BLOCK_LEN*(MAX_INSN_CODE+MAX_EXIT_CODE))
+
+/* block code gets the machine as base pointer */
+#define OFF(field) ((int32_t)offsetof(struct chip8, field))
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum { CC_B=2, CC_E=4, CC_NE=5, CC_A=7 };
+
+/* ALU opcodes, "op r/m, reg" forms */
+#define ADD8 0x00
+#define SUB8 0x28
+#define ADD 0x01
+#define OR 0x09
+#define AND 0x21
+#define SUB 0x29
+#define XOR 0x31
+#define CMP 0x39
+#define MOV 0x89
+
+struct block {
+	unsigned (*fn)(struct chip8 *c8, unsigned budget);
+	unsigned char len; /* in instructions, 0 if not translatable */
+	unsigned char done;
+};
+
+struct jit {
+	struct block BLOCKS[0x1000/2];
+	unsigned char CODE[0x1000]; /* RAM bytes translated in some block */
+
+	unsigned char *code;
+	size_t code_used;
+};
+
+/* translation state, only used while compiling a block */
+static _Thread_local unsigned char *out;
+
+#define GI 16 /* guest I, after V0..VF */
+static const unsigned char pool[] = { /* rsi holds the budget */
+	RBX, RCX, RDI, R8, R9, R10, R11, R12, R13, R14, R15
+};
+static _Thread_local signed char host[17];
+static _Thread_local unsigned loaded, dirty; /* guest register bitmasks */
+static _Thread_local unsigned nalloc;
+
+static void byte(unsigned b){
+	*out++ = b;
+}
+
+static void dword(uint32_t d){
+	memcpy(out, &d, 4);
+	out += 4;
+}
+
+/* force is needed for byte registers 4..7 to mean spl..dil, not ah..bh */
+static void rex(int w, int reg, int rm, int force){
+	unsigned r = 0x40 | w<<3 | (reg>>3)<<2 | (rm>>3);
+	if(r != 0x40 || force)
+		byte(r);
+}
+
+static void modrm_rr(int reg, int rm){
+	byte(0xC0 | (reg&7)<<3 | (rm&7));
+}
+
+static void modrm_base(int reg, int32_t disp){ /* [rbp+disp32] */
+	byte(0x80 | (reg&7)<<3 | RBP);
+	dword(disp);
+}
+
+static void alu32(unsigned opc, int dst, int src){
+	rex(0, src, dst, 0);
+	byte(opc);
+	modrm_rr(src, dst);
+}
+
+static void mov64(int dst, int src){
+	rex(1, src, dst, 0);
+	byte(MOV);
+	modrm_rr(src, dst);
+}
+
+static void alu8(unsigned opc, int dst, int src){
+	rex(0, src, dst, 1);
+	byte(opc);
+	modrm_rr(src, dst);
+}
+
+static void mov_imm(int dst, uint32_t imm){
+	rex(0, 0, dst, 0);
+	byte(0xB8 + (dst&7));
+	dword(imm);
+}
+
+static void alu_imm(int ext, int dst, uint32_t imm){ /* 81 /ext id */
+	rex(0, 0, dst, 0);
+	byte(0x81);
+	modrm_rr(ext, dst);
+	dword(imm);
+}
+
+static void add8_imm(int dst, unsigned imm){
+	rex(0, 0, dst, 1);
+	byte(0x80);
+	modrm_rr(0, dst);
+	byte(imm);
+}
+
+static void shr_imm(int dst, unsigned n){
+	rex(0, 0, dst, 0);
+	byte(0xC1);
+	modrm_rr(5, dst);
+	byte(n);
+}
+
+static void shift8(int ext, int dst){ /* D0 /ext, by one */
+	rex(0, 0, dst, 1);
+	byte(0xD0);
+	modrm_rr(ext, dst);
+}
+
+static void setcc(unsigned cc, int dst){
+	rex(0, 0, dst, 1);
+	byte(0x0F);
+	byte(0x90 | cc);
+	modrm_rr(0, dst);
+}
+
+static void cmovcc(unsigned cc, int dst, int src){
+	rex(0, dst, src, 0);
+	byte(0x0F);
+	byte(0x40 | cc);
+	modrm_rr(dst, src);
+}
+
+static void movzx8(int dst, int src){
+	rex(0, dst, src, 1);
+	byte(0x0F);
+	byte(0xB6);
+	modrm_rr(dst, src);
+}
+
+static void load8(int dst, int32_t disp){
+	rex(0, dst, 0, 0);
+	byte(0x0F);
+	byte(0xB6);
+	modrm_base(dst, disp);
+}
+
+static void load16(int dst, int32_t disp){
+	rex(0, dst, 0, 0);
+	byte(0x0F);
+	byte(0xB7);
+	modrm_base(dst, disp);
+}
+
+static void store8(int32_t disp, int src){
+	rex(0, src, 0, 1);
+	byte(0x88);
+	modrm_base(src, disp);
+}
+
+static void store16(int32_t disp, int src){
+	byte(0x66);
+	rex(0, src, 0, 0);
+	byte(0x89);
+	modrm_base(src, disp);
+}
+
+static void store16_imm(int32_t disp, unsigned imm){
+	byte(0x66);
+	byte(0xC7);
+	modrm_base(0, disp);
+	byte(imm&0xff);
+	byte(imm>>8);
+}
+
+static void push(int r){
+	rex(0, 0, r, 0);
+	byte(0x50 + (r&7));
+}
+
+static void pop(int r){
+	rex(0, 0, r, 0);
+	byte(0x58 + (r&7));
+}
+
+/* host register holding guest register g, loaded on first use */
+static int reg(int g){
+	if(!(loaded & 1u<<g)){
+		host[g] = pool[nalloc++];
+		loaded |= 1u<<g;
+		if(g == GI)
+			load16(host[g], OFF(I));
+		else
+			load8(host[g], OFF(V)+g);
+	}
+	return host[g];
+}
+
+static int wreg(int g){
+	dirty |= 1u<<g;
+	return reg(g);
+}
+
+/* guest registers used by a translatable instruction, 0 if not translatable */
+static unsigned uses(const struct op *o){
+	unsigned x = 1u<<o->x, y = 1u<<o->y, f = 1u<<0xf, i = 1u<<GI;
+	switch(o->id){
+		case OP_1nnn: return 1u<<31; /* no register, but translatable */
+		case OP_3xnn: case OP_4xnn: return x;
+		case OP_5xy0: case OP_9xy0: return x|y;
+		case OP_6xnn: case OP_7xnn: return x;
+		case OP_8xy0: case OP_8xy1: case OP_8xy2: case OP_8xy3: return x|y;
+		case OP_8xy4: case OP_8xy5: case OP_8xy7: return x|y|f;
+		case OP_8xy6: case OP_8xye: return x|f;
+		case OP_annn: return i;
+		case OP_fx07: case OP_fx15: case OP_fx18: return x;
+		case OP_fx1e: return x|i|f;
+		default: return 0;
+	}
+}
+
+/* returns whether the instruction ends the block */
+static int translate(const struct op *o, unsigned pc){
+	int hx, hy, hf;
+
+	switch(o->id){
+		case OP_1nnn:
+			store16_imm(OFF(PC), o->nnn);
+			return 1;
+		case OP_3xnn:
+		case OP_4xnn:
+			hx = reg(o->x);
+			mov_imm(RAX, pc+2);
+			mov_imm(RDX, pc+4);
+			alu_imm(7, hx, o->nn); /* cmp */
+			cmovcc(o->id == OP_3xnn ? CC_E : CC_NE, RAX, RDX);
+			store16(OFF(PC), RAX);
+			return 1;
+		case OP_5xy0:
+		case OP_9xy0:
+			hx = reg(o->x);
+			hy = reg(o->y);
+			mov_imm(RAX, pc+2);
+			mov_imm(RDX, pc+4);
+			alu32(CMP, hx, hy);
+			cmovcc(o->id == OP_5xy0 ? CC_E : CC_NE, RAX, RDX);
+			store16(OFF(PC), RAX);
+			return 1;
+		case OP_6xnn:
+			mov_imm(wreg(o->x), o->nn);
+			return 0;
+		case OP_7xnn:
+			add8_imm(wreg(o->x), o->nn);
+			return 0;
+		case OP_8xy0:
+			alu32(MOV, wreg(o->x), reg(o->y));
+			return 0;
+		case OP_8xy1:
+			alu32(OR, wreg(o->x), reg(o->y));
+			return 0;
+		case OP_8xy2:
+			alu32(AND, wreg(o->x), reg(o->y));
+			return 0;
+		case OP_8xy3:
+			alu32(XOR, wreg(o->x), reg(o->y));
+			return 0;
+		/*
+		 * Flag setting instructions follow the interpreter step by
+		 * step: VF is written first and the result re-reads the
+		 * registers, which matters when X or Y is F.
+		 */
+		case OP_8xy4:
+			hx = wreg(o->x), hy = reg(o->y), hf = wreg(0xf);
+			alu32(MOV, RAX, hx);
+			alu32(ADD, RAX, hy);
+			shr_imm(RAX, 8);
+			alu32(MOV, hf, RAX);
+			alu8(ADD8, hx, hy);
+			return 0;
+		case OP_8xy5:
+			hx = wreg(o->x), hy = reg(o->y), hf = wreg(0xf);
+			alu32(XOR, RAX, RAX);
+			alu32(CMP, hx, hy);
+			setcc(CC_A, RAX);
+			alu32(MOV, hf, RAX);
+			alu8(SUB8, hx, hy);
+			return 0;
+		case OP_8xy6:
+			hx = wreg(o->x), hf = wreg(0xf);
+			alu32(MOV, RAX, hx);
+			alu_imm(4, RAX, 1); /* and */
+			alu32(MOV, hf, RAX);
+			shift8(5, hx); /* shr */
+			return 0;
+		case OP_8xy7:
+			hx = wreg(o->x), hy = reg(o->y), hf = wreg(0xf);
+			alu32(XOR, RAX, RAX);
+			alu32(CMP, hx, hy);
+			setcc(CC_B, RAX);
+			alu32(MOV, hf, RAX);
+			alu32(MOV, RAX, hy);
+			alu32(SUB, RAX, hx);
+			movzx8(hx, RAX);
+			return 0;
+		case OP_8xye:
+			hx = wreg(o->x), hf = wreg(0xf);
+			alu32(MOV, RAX, hx);
+			shr_imm(RAX, 7);
+			alu32(MOV, hf, RAX);
+			shift8(4, hx); /* shl */
+			return 0;
+		case OP_annn:
+			mov_imm(wreg(GI), o->nnn);
+			return 0;
+		case OP_fx07:
+			load8(wreg(o->x), OFF(DT));
+			return 0;
+		case OP_fx15:
+			store8(OFF(DT), reg(o->x));
+			return 0;
+		case OP_fx18:
+			store8(OFF(ST), reg(o->x));
+			return 0;
+		case OP_fx1e:
+			hx = reg(o->x);
+			hy = wreg(GI), hf = wreg(0xf);
+			alu32(ADD, hy, hx);
+			alu32(MOV, RAX, hy);
+			shr_imm(RAX, 12);
+			alu32(MOV, hf, RAX);
+			alu_imm(4, hy, 0xfff); /* and */
+			return 0;
+		default: /* unreachable, filtered by uses() */
+			return 1;
+	}
+}
+
+static const unsigned char saved[] = {RBX, RBP, R12, R13, R14, R15};
+
+static void store_dirty(unsigned mask){
+	for(int g=0 ; g<17 ; g++){
+		if(!(mask & 1u<<g))
+			continue;
+		if(g == GI)
+			store16(OFF(I), host[g]);
+		else
+			store8(OFF(V)+g, host[g]);
+	}
+}
+
+static unsigned char *jump32(unsigned char *at, const unsigned char *to){
+	int32_t rel = to - (at+4);
+	memcpy(at, &rel, 4);
+	return at;
+}
+
+/*
+ * Block code is called as fn(c8, budget) and returns the number of
+ * instructions it executed: it leaves early when the budget runs out so
+ * that the engine stops exactly after n instructions.
+ */
+static void compile(struct chip8 *c8, struct block *b, unsigned start){
+	struct jit *j = c8->jit;
+	struct {
+		unsigned char *jz;
+		unsigned short pc;
+		unsigned dirty;
+	} exits[MAX_BLOCK_LEN];
+	unsigned pc = start;
+	int ended = 0;
+
+	if(j->code_used + MAX_BLOCK_CODE > CODE_SIZE)
+		jit_flush(c8);
+
+	b->done = 1;
+	b->len = 0;
+	b->fn = NULL;
+
+	out = j->code + j->code_used;
+	loaded = dirty = nalloc = 0;
+
+	for(unsigned i=0 ; i<sizeof(saved) ; i++)
+		push(saved[i]);
+	mov64(RBP, RDI);
+
+	while(!ended && b->len < MAX_BLOCK_LEN && pc+1 < 0x1000){
+		struct op o = decode(&c8->RAM[pc]);
+		unsigned use = uses(&o);
+		if(!use)
+			break;
+		if(__builtin_popcount(use & ~loaded & 0x1ffff) + nalloc > sizeof(pool))
+			break;
+
+		if(b->len){ /* budget check: dec esi, jz exit */
+			byte(0xFF), modrm_rr(1, RSI);
+			byte(0x0F), byte(0x84);
+			exits[b->len-1].jz = out;
+			exits[b->len-1].pc = pc;
+			exits[b->len-1].dirty = dirty;
+			dword(0);
+		}
+
+		ended = translate(&o, pc);
+		b->len++;
+		pc += 2;
+	}
+
+	if(!b->len){ /* still watched, a write may make it translatable */
+		memset(j->CODE+start, 1, 2);
+		return;
+	}
+
+	if(!ended)
+		store16_imm(OFF(PC), pc);
+	store_dirty(dirty);
+	mov_imm(RAX, b->len);
+
+	unsigned char *epilogue = out;
+	for(int i=sizeof(saved)-1 ; i>=0 ; i--)
+		pop(saved[i]);
+	byte(0xC3); /* ret */
+
+	for(unsigned i=0 ; i+1<b->len ; i++){
+		jump32(exits[i].jz, out);
+		store16_imm(OFF(PC), exits[i].pc);
+		store_dirty(exits[i].dirty);
+		mov_imm(RAX, i+1);
+		byte(0xE9); /* jmp */
+		jump32(out, epilogue);
+		out += 4;
+	}
+
+	assert(out <= j->code + j->code_used + MAX_BLOCK_CODE);
+	b->fn = (unsigned (*)(struct chip8 *, unsigned))(j->code + j->code_used);
+	j->code_used = out - j->code;
+	memset(j->CODE+start, 1, pc-start);
+}
+
+void jit_flush(struct chip8 *c8){
+	struct jit *j = c8->jit;
+	if(!j)
+		return;
+
+	memset(j->BLOCKS, 0, sizeof(j->BLOCKS));
+	memset(j->CODE, 0, sizeof(j->CODE));
+	j->code_used = 0;
+}
+
+/* drop blocks translated from RAM[addr..addr+len) */
+void jit_invalidate(struct chip8 *c8, unsigned addr, unsigned len){
+	struct jit *j = c8->jit;
+	if(!j)
+		return;
+
+	for(unsigned a=addr ; a<addr+len ; a++){
+		if(!j->CODE[a])
+			continue;
+
+		unsigned first = a > 2*MAX_BLOCK_LEN ? a-2*MAX_BLOCK_LEN : 0;
+		for(unsigned s=first&~1u ; s<=a ; s+=2){
+			struct block *b = &j->BLOCKS[s/2];
+			if(b->done && s+2*(b->len ? b->len : 1) > a)
+				b->done = b->len = 0;
+		}
+	}
+}
+
+static int jit_init(struct chip8 *c8){
+	/* shared by batch threads, one failed mmap is enough to give up */
+	static atomic_int unavailable;
+	if(atomic_load(&unavailable))
+		return 0;
+
+	struct jit *j = calloc(1, sizeof(*j));
+	if(!j)
+		return 0;
+	j->code = mmap(NULL, CODE_SIZE, PROT_READ|PROT_WRITE|PROT_EXEC,
+			MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(j->code == MAP_FAILED){
+		perror("JIT disabled, mmap");
+		free(j);
+		atomic_store(&unavailable, 1);
+		return 0;
+	}
+	c8->jit = j;
+	return 1;
+}
+
+void jit_free(struct chip8 *c8){
+	struct jit *j = c8->jit;
+	if(!j)
+		return;
+
+	munmap(j->code, CODE_SIZE);
+	free(j);
+	c8->jit = NULL;
+}
+
+void run_jit(struct chip8 *c8, unsigned long n){
+	if(!c8->jit && !jit_init(c8)){
+		while(n--)
+			step(c8);
+		return;
+	}
+
+	while(n){
+		unsigned pc = c8->PC;
+		if(pc >= 0x200 && pc < 0x1000 && !(pc&1)){
+			struct block *b = &c8->jit->BLOCKS[pc/2];
+			if(!b->done)
+				compile(c8, b, pc);
+			if(b->len){
+				unsigned done = b->fn(c8, n > b->len ? b->len : n);
+				/* one record per block, only the first instruction shows */
+				TRACE(c8, pc, c8->RAM[pc]<<8 | c8->RAM[pc+1], done);
+				PROFILE(PROF_JIT, done);
+				n -= done;
+				continue;
+			}
+		}
+		step(c8);
+		n--;
+	}
+}
+
+#endif /* __x86_64__ */
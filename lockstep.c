@@ -0,0 +1,385 @@
+/*
+ * Lockstep engine: many machines running the same ROM, registers kept one
+ * vector per register so the lanes that agree on PC execute an instruction
+ * with a handful of vector operations. Anything not worth vectorising (and
+ * lanes whose code was overwritten differently) goes through step() on the
+ * lane's own struct chip8, with the registers copied in and out.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lockstep.h"
+#include "metrics.h"
+#include "trace.h"
+
+/* a where the mask is set, b elsewhere */
+#define SEL(m, a, b) (((a)&(m)) | ((b)&~(m)))
+
+/* hot loop built for AVX2 and for the baseline (SSE2), picked at load time */
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SIMD __attribute__((target_clones("avx2", "default")))
+#else
+#define SIMD
+#endif
+
+/*
+ * Comparisons as bit tricks giving 0 or 1 per lane: GCC only emits vector
+ * compares at the hardware width and goes element by element otherwise,
+ * while plain arithmetic is split into as many registers as needed.
+ */
+#define NZ8(a) (((a) | -(a)) >> 7)
+#define NZ16(a) (((a) | -(a)) >> 15)
+#define LT8(a, b) (((~(a) & (b)) | (~((a) ^ (b)) & ((a) - (b)))) >> 7)
+
+#define WIDE(a) __builtin_convertvector((a), lane16)
+#define NARROW(a) __builtin_convertvector((a), lane8)
+
+static void gather(struct lanes *l, unsigned k){
+	struct chip8 *c8 = &l->lane[k];
+	for(int r=0 ; r<16 ; r++)
+		c8->V[r] = l->V[r][k];
+	c8->I = l->I[k];
+	c8->PC = l->PC[k];
+	c8->DT = l->DT[k];
+	c8->ST = l->ST[k];
+}
+
+static void scatter(struct lanes *l, unsigned k){
+	const struct chip8 *c8 = &l->lane[k];
+	for(int r=0 ; r<16 ; r++)
+		l->V[r][k] = c8->V[r];
+	l->I[k] = c8->I;
+	l->PC[k] = c8->PC;
+	l->DT[k] = c8->DT;
+	l->ST[k] = c8->ST;
+}
+
+/* lanes may no longer agree on these bytes */
+static void written(struct lanes *l, unsigned addr, unsigned len){
+	for( ; len && addr < sizeof(l->written) ; len--)
+		l->written[addr++] = 1;
+}
+
+/* one lane at a time through the scalar core, o is NULL for a bad PC */
+static void scalar(struct lanes *l, const lane16 *m, const struct op *o){
+	for(unsigned k=0 ; k<l->n ; k++){
+		if(!(*m)[k])
+			continue;
+
+		unsigned I = l->I[k];
+		gather(l, k);
+		step(&l->lane[k]);
+		scatter(l, k);
+
+		if(o && o->id == OP_fx33)
+			written(l, I, 3);
+		else if(o && o->id == OP_fx55)
+			written(l, I, o->x+1);
+	}
+}
+
+/* DXYN on the lane's own screen */
+static void draw_lane(struct lanes *l, unsigned k, const struct op *o){
+	struct chip8 *c8 = &l->lane[k];
+	unsigned I = l->I[k], size = SPRITE_SIZE(o->n, c8->hires);
+
+	if(I+size >= 0x1000){
+		WARN("Sprite data out of memory bounds: %X..%X\n", I, I+size);
+		return;
+	}
+
+	l->V[0xf][k] = 0;
+	l->V[0xf][k] = draw_sprite(c8->SCREEN, c8->hires, &c8->RAM[I], o->n,
+			l->V[o->x][k], l->V[o->y][k]);
+}
+
+/* decode the leader's instruction, dropping lanes that hold other code */
+static struct op fetch(struct lanes *l, unsigned leader, unsigned pc, lane16 *m){
+	const unsigned char *instr = &l->lane[leader].RAM[pc];
+
+	if(l->written[pc] || l->written[pc+1]){
+		for(unsigned k=0 ; k<l->n ; k++)
+			if((*m)[k] && memcmp(&l->lane[k].RAM[pc], instr, 2))
+				(*m)[k] = 0;
+		return decode(instr);
+	}
+
+	/* odd addresses straddle two entries, don't cache them */
+	if(pc&1)
+		return decode(instr);
+	if(!l->decoded[pc/2]){
+		l->OPS[pc/2] = decode(instr);
+		l->decoded[pc/2] = 1;
+	}
+	return l->OPS[pc/2];
+}
+
+/*
+ * Execute o on the lanes in m, all of them at the same PC: register work
+ * as vector operations, per machine state (stack, keys, RNG, RAM reads)
+ * lane by lane. Only RAM writes go through step(), which also keeps the
+ * lane's own predecoded instructions up to date.
+ */
+static inline void exec(struct lanes *l, const lane16 *mask, const struct op *o){
+	lane8 *V = l->V;
+	lane16 m = *mask;
+	lane8 m8 = NARROW(m);
+	lane8 c;
+
+#define VX V[o->x]
+#define VY V[o->y]
+#define VF V[0xf]
+#define SKIP(bit) (l->PC += WIDE(bit)*2 & m)
+#define EACH(k) for(unsigned k=0 ; k<l->n ; k++) if(m[k])
+
+	switch(o->id){
+		case OP_0nnn: case OP_unknown: case OP_fx33: case OP_fx55:
+		/* SCHIP, rare enough */
+		case OP_00cn: case OP_00fb: case OP_00fc: case OP_00fd:
+		case OP_00fe: case OP_00ff: case OP_fx30: case OP_fx75: case OP_fx85:
+			scalar(l, mask, o);
+			return;
+	}
+
+	l->PC += m & 2;
+	switch(o->id){
+		case OP_00e0:
+			EACH(k)
+				memset(l->lane[k].SCREEN, 0, sizeof(l->lane[k].SCREEN));
+			break;
+		case OP_00ee:
+			EACH(k){
+				struct chip8 *c8 = &l->lane[k];
+				if(!c8->SP)
+					WARN("Stack underflow\n");
+				else
+					l->PC[k] = c8->STACK[--c8->SP];
+			}
+			break;
+		case OP_1nnn: l->PC = SEL(m, o->nnn, l->PC); break;
+		case OP_2nnn:
+			EACH(k){
+				struct chip8 *c8 = &l->lane[k];
+				if(c8->SP==STACK_SIZE)
+					WARN("Stack overflow\n");
+				else
+					c8->STACK[c8->SP++] = l->PC[k];
+			}
+			l->PC = SEL(m, o->nnn, l->PC);
+			break;
+		case OP_3xnn: SKIP(NZ8(VX ^ o->nn) ^ 1); break;
+		case OP_4xnn: SKIP(NZ8(VX ^ o->nn)); break;
+		case OP_5xy0: SKIP(NZ8(VX ^ VY) ^ 1); break;
+		case OP_6xnn: VX = SEL(m8, o->nn, VX); break;
+		case OP_7xnn: VX += m8 & o->nn; break;
+		case OP_8xy0: VX = SEL(m8, VY, VX); break;
+		case OP_8xy1: VX |= m8 & VY; break;
+		case OP_8xy2: VX &= VY | ~m8; break;
+		case OP_8xy3: VX ^= m8 & VY; break;
+		case OP_8xy4:
+			c = LT8(VX+VY, VX);
+			VF = SEL(m8, c, VF);
+			VX += m8 & VY;
+			break;
+		case OP_8xy5:
+			c = LT8(VY, VX);
+			VF = SEL(m8, c, VF);
+			VX -= m8 & VY;
+			break;
+		case OP_8xy6:
+			c = VX & 1;
+			VF = SEL(m8, c, VF);
+			VX = SEL(m8, VX >> 1, VX);
+			break;
+		case OP_8xy7:
+			c = LT8(VX, VY);
+			VF = SEL(m8, c, VF);
+			VX = SEL(m8, VY - VX, VX);
+			break;
+		case OP_8xye:
+			c = VX >> 7;
+			VF = SEL(m8, c, VF);
+			VX = SEL(m8, VX << 1, VX);
+			break;
+		case OP_9xy0: SKIP(NZ8(VX ^ VY)); break;
+		case OP_annn: l->I = SEL(m, o->nnn, l->I); break;
+		case OP_bnnn:
+			l->PC = SEL(m, o->nnn + WIDE(V[0]), l->PC);
+			break;
+		case OP_cxnn:
+			EACH(k)
+				VX[k] = rand_r(&l->lane[k].seed) & o->nn;
+			break;
+		case OP_dxyn:
+			EACH(k)
+				draw_lane(l, k, o);
+			break;
+		case OP_ex9e:
+			EACH(k){
+				struct chip8 *c8 = &l->lane[k];
+				if(VX[k] > 16)
+					WARN("Unknown key: %u\n", (unsigned)VX[k]);
+				if(c8->KEYBOARD & 1<<(VX[k]))
+					l->PC[k] += 2;
+			}
+			break;
+		case OP_exa1:
+			EACH(k){
+				struct chip8 *c8 = &l->lane[k];
+				if(VX[k] > 16)
+					WARN("Unknown key: %u\n", (unsigned)VX[k]);
+				if(!(c8->KEYBOARD & 1<<(VX[k])))
+					l->PC[k] += 2;
+			}
+			break;
+		case OP_fx07: VX = SEL(m8, l->DT, VX); break;
+		case OP_fx0a:
+			EACH(k){
+				unsigned short keys = l->lane[k].KEYBOARD;
+				if(!keys)
+					l->PC[k] -= 2;
+				else {
+					unsigned char v = 0;
+					for( ; !(keys&1) ; keys>>=1)
+						v++;
+					VX[k] = v;
+				}
+			}
+			break;
+		case OP_fx15: l->DT = SEL(m8, VX, l->DT); break;
+		case OP_fx18: l->ST = SEL(m8, VX, l->ST); break;
+		case OP_fx1e: {
+			lane16 I = l->I + (WIDE(VX) & m);
+			VF = SEL(m8, NARROW(I >> 12), VF);
+			l->I = SEL(m, I & 0xfff, l->I);
+			break;
+		}
+		case OP_fx29:
+			EACH(k){
+				struct chip8 *c8 = &l->lane[k];
+				if(VX[k]>0xF)
+					WARN("Too large input for a digit: %X\n", (unsigned)VX[k]);
+				else
+					l->I[k] = CHAR_SPRITES_OFFSET + 5*VX[k];
+			}
+			break;
+		case OP_fx65:
+			EACH(k){
+				const struct chip8 *c8 = &l->lane[k];
+				const unsigned char *RAM = c8->RAM;
+				unsigned I = l->I[k];
+				if(I+o->x >= 0x1000){
+					WARN("Register load out of memory bounds: %X..%X\n",
+							I, I+o->x);
+					continue;
+				}
+				for(unsigned i=0 ; i<=o->x ; i++)
+					V[i][k] = RAM[I+i];
+			}
+			break;
+	}
+
+#undef VX
+#undef VY
+#undef VF
+#undef SKIP
+#undef EACH
+}
+
+SIMD void lanes_frame(struct lanes *l){
+	lane16 left = l->active & FREQ/60;
+
+	for(;;){
+		/* the first lane with budget left leads, everyone at its PC follows */
+		unsigned k = 0;
+		while(k < l->n && !left[k])
+			k++;
+		if(k == l->n)
+			break;
+
+		unsigned short pc = l->PC[k];
+		lane16 m = (NZ16(l->PC ^ pc) - 1) & -NZ16(left);
+
+		/* the scalar core warns, and 0xFFF reads past RAM */
+		if(pc < 0x200 || pc >= 0x1000-1)
+			scalar(l, &m, NULL);
+		else {
+			struct op o = fetch(l, k, pc, &m);
+			exec(l, &m, &o);
+		}
+
+		left -= m & 1;
+	}
+
+	l->DT -= NZ8(l->DT);
+	l->ST -= NZ8(l->ST);
+}
+
+void lanes_reset(struct lanes *l, unsigned n, unsigned seed,
+		const unsigned char *rom, size_t size){
+	if(n > LANES)
+		n = LANES;
+
+	memset(l, 0, sizeof(*l));
+	l->n = n;
+	for(unsigned k=0 ; k<n ; k++){
+		reset(&l->lane[k], rom, size);
+		l->lane[k].seed = seed+k;
+		l->active[k] = 0xffff;
+	}
+	l->PC = l->active & 0x200;
+}
+
+void lanes_get(const struct lanes *l, unsigned k, struct chip8 *c8){
+	memcpy(c8, &l->lane[k], offsetof(struct chip8, engine));
+	for(int r=0 ; r<16 ; r++)
+		c8->V[r] = l->V[r][k];
+	c8->I = l->I[k];
+	c8->PC = l->PC[k];
+	c8->DT = l->DT[k];
+	c8->ST = l->ST[k];
+}
+
+int lockstep(const unsigned char *rom, size_t size,
+		unsigned n, unsigned long frames){
+	struct lanes *l = aligned_alloc(_Alignof(struct lanes), sizeof(*l));
+	struct chip8 *c8 = malloc(sizeof(*c8));
+	if(!l || !c8){
+		perror("lockstep");
+		return 2;
+	}
+
+	double start = now();
+	for(unsigned base=0 ; base<n ; base+=LANES){
+		unsigned count = n-base < LANES ? n-base : LANES;
+		unsigned input[LANES];
+
+		lanes_reset(l, count, base+1, rom, size);
+		for(unsigned k=0 ; k<count ; k++)
+			input[k] = base+k;
+
+		for(unsigned long f=0 ; f<frames ; f++){
+			/* hold a random key (or none) for 16 frames */
+			if(!(f%16))
+				for(unsigned k=!base ; k<count ; k++){
+					unsigned key = rand_r(&input[k])%17;
+					l->lane[k].KEYBOARD = key < 16 ? 1u<<key : 0;
+				}
+			lanes_frame(l);
+		}
+
+		for(unsigned k=0 ; k<count ; k++){
+			lanes_get(l, k, c8);
+			printf("%016llx %u\n", fnv1a(c8->SCREEN, sizeof(c8->SCREEN)), base+k);
+		}
+	}
+	double secs = now() - start;
+
+	fprintf(stderr, "%u lanes, %.3fs, %.2f MIPS\n",
+			n, secs, (double)n*frames*(FREQ/60)/secs/1e6);
+
+	free(c8);
+	free(l);
+	return 0;
+}
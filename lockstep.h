@@ -0,0 +1,55 @@
+#ifndef C8_LOCKSTEP_H
+#define C8_LOCKSTEP_H
+
+#include "chip8.h"
+
+#define LANES 32
+
+/* aligned explicitly, the default depends on the instruction set */
+typedef unsigned char lane8
+	__attribute__((vector_size(LANES), aligned(LANES)));
+typedef unsigned short lane16
+	__attribute__((vector_size(2*LANES), aligned(2*LANES)));
+
+/*
+ * Up to LANES machines running the same ROM. The registers are kept as one
+ * vector per register, lane k holding machine k, so lanes sitting at the
+ * same PC execute each instruction together. The rest of each machine
+ * (RAM, screen, stack, keyboard, RNG, SCHIP mode and flags) stays in
+ * lane[k]; set lane[k].KEYBOARD directly between frames.
+ */
+struct lanes {
+	lane8 V[16];
+	lane16 I;
+	lane16 PC;
+	lane8 DT;
+	lane8 ST;
+
+	unsigned n;
+	lane16 active;
+
+	/* shared decode of the ROM, bypassed where any lane wrote RAM */
+	struct op OPS[0x1000/2];
+	unsigned char decoded[0x1000/2];
+	unsigned char written[0x1000];
+
+	struct chip8 lane[LANES];
+};
+
+/* power-on state for n lanes, lane k gets RNG seed seed+k */
+void lanes_reset(struct lanes *l, unsigned n, unsigned seed,
+		const unsigned char *rom, size_t size);
+/* run one 60Hz frame on every lane: FREQ/60 instructions, then tick */
+void lanes_frame(struct lanes *l);
+/* copy out the full state of lane k */
+void lanes_get(const struct lanes *l, unsigned k, struct chip8 *c8);
+
+/*
+ * Run n copies of the ROM for the given number of frames. Lane k gets RNG
+ * seed k+1 and random key presses, except lane 0 which never presses a key
+ * and so matches a batch run. Prints the screen hash of every lane.
+ */
+int lockstep(const unsigned char *rom, size_t size,
+		unsigned n, unsigned long frames);
+
+#endif /* C8_LOCKSTEP_H */
@@ -9,6 +9,7 @@
 #define MINIAUDIO_IMPLEMENTATION
 #include "ext/miniaudio.h"
 
+#include "expand.h"
 #include "media.h"
 
 #define PIXEL_RADIUS 16
@@ -18,7 +19,7 @@
 
 #define WINDOW_NAME "CHIP-8 emulator"
 
-#define NUM_PIXELS (32*64)
+#define NUM_PIXELS (64*128)
 
 #define SOUND_DEV_FREQ 48000
 #define SOUND_DEV_FORMAT ma_format_f32
@@ -28,7 +29,9 @@
 #define BUZZER_FREQ 440
 #define BUZZER_VOL .05
 
+/* width x height, the size of the texture */
 unsigned char pixels[NUM_PIXELS];
+int width = 64, height = 32;
 
 GLFWwindow *window;
 
@@ -59,6 +62,7 @@ const char *f_shader_src =
 
 
 unsigned short input;
+int rewind_state;
 
 
 /* sound state*/
@@ -93,6 +97,8 @@ static void buzzer_callback(ma_device *d, void *out, const void *in, ma_uint32 f
 
 static void key_callback(GLFWwindow* window, int key, int s, int action, int m){
 	(void) s, (void)m, (void) window;
+	if (key == GLFW_KEY_BACKSPACE && action != GLFW_REPEAT)
+		rewind_state = action == GLFW_PRESS;
 	for (int i=0 ; i<16 ; i++) {
 		if (key == keys[i]){
 			if (action == GLFW_PRESS)
@@ -162,7 +168,7 @@ static void setup_texture(void){
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 32, 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
 }
 
 static void init_graphics(void){
@@ -235,6 +241,10 @@ unsigned short get_input(unsigned short old_input){
 
 	return input;
 }
+int get_rewind(void){
+	return rewind_state;
+}
+
 unsigned short wait_input(unsigned short input){
 	int new_input;
 	
@@ -244,26 +254,39 @@ unsigned short wait_input(unsigned short input){
 	return new_input;
 }
 
-void clear_screen(void){
-	memset(pixels,0,NUM_PIXELS);
-	glClear(GL_COLOR_BUFFER_BIT);
-}
+void present(const uint64_t screen[][2], int new_width, int new_height,
+		int x, int y, int w, int h){
+	assert((new_width==64 && new_height==32) || (new_width==128 && new_height==64));
+	assert(0<=x && 0<w && x+w<=new_width);
+	assert(0<=y && 0<h && y+h<=new_height);
 
-void draw(int x, int y, int value){
-	assert(0<=x && x<64);
-	assert(0<=y && y<32);
+	/* the quad stays the window size, pixels get smaller */
+	if(new_width != width){
+		width = new_width, height = new_height;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, width, height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, NULL);
+	}
 
-	pixels[y*64+x] = value ? 255 : 0;
+	/* whole rows, GLES2 can't upload part of one from a wider buffer */
+	for(int i=y ; i<y+h ; i++)
+		for(int j=0 ; j<width ; j+=64)
+			expand8(pixels + i*width + j, screen[i][j/64], 64);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, width, h,
+			GL_ALPHA, GL_UNSIGNED_BYTE, pixels + y*width);
 }
 
 void frame(void){
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, 64, 32, 0, GL_ALPHA, GL_UNSIGNED_BYTE, pixels);
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
 	glfwSwapBuffers(window);
 	glfwPollEvents();
 }
 
+void set_title(const char *status){
+	char title[256];
+	snprintf(title, sizeof(title), "%s - %s", WINDOW_NAME, status);
+	glfwSetWindowTitle(window, title);
+}
+
 void set_buzzer_state(int state){
 	static int old_state = 0;
 	if(state != old_state){
@@ -0,0 +1,141 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "media.h"
+
+/*
+ * No window, no audio: for machines without a display and for benchmarks.
+ *
+ * C8_FRAMES=n quits (get_input() returns -1) after n frames.
+ * C8_INPUT=file plays keys from a script, one "frame keys" line per
+ * change, frame in decimal and the 16-bit key mask in hex, bit 16 being
+ * the rewind key, e.g.
+ *
+ *     # hold 5 from frame 120 to 180, then rewind for a second
+ *     120 0020
+ *     180 0
+ *     300 10000
+ *     360 0
+ */
+
+struct event {
+	unsigned long frame;
+	unsigned short keys;
+	int rewind;
+};
+
+struct event *events;
+size_t num_events;
+size_t next_event;
+
+unsigned long frames;
+unsigned long max_frames;
+
+unsigned short keys;
+int rewind_state;
+
+/* -1 if out of memory, a missing script only plays no keys */
+static int read_script(const char *path){
+	FILE *f = fopen(path, "r");
+	if(!f){
+		perror(path);
+		return 0;
+	}
+
+	char line[256];
+	size_t cap = 0;
+	while(fgets(line, sizeof(line), f)){
+		struct event e;
+		unsigned k;
+		if(line[0] == '#' || sscanf(line, "%lu %x", &e.frame, &k) != 2)
+			continue;
+		e.keys = k;
+		e.rewind = k>>16 & 1;
+		if(num_events == cap){
+			size_t new_cap = cap ? 2*cap : 64;
+			struct event *grown = realloc(events, new_cap*sizeof(*events));
+			if(!grown){
+				perror(path);
+				free(events);
+				events = NULL;
+				num_events = 0;
+				fclose(f);
+				return -1;
+			}
+			events = grown;
+			cap = new_cap;
+		}
+		events[num_events++] = e;
+	}
+	fclose(f);
+	return 0;
+}
+
+int m_init(int argc, char **argv){
+	(void)argc, (void)argv;
+
+	const char *env = getenv("C8_FRAMES");
+	if(env)
+		max_frames = strtoul(env, NULL, 0);
+	env = getenv("C8_INPUT");
+	if(env && read_script(env))
+		return -1;
+
+	return 0;
+}
+
+void m_quit(void){
+	free(events);
+}
+
+unsigned short get_input(unsigned short input){
+	(void)input;
+
+	if(max_frames && frames >= max_frames)
+		return -1;
+
+	for( ; next_event < num_events && events[next_event].frame <= frames ; next_event++){
+		keys = events[next_event].keys;
+		rewind_state = events[next_event].rewind;
+	}
+
+	return keys;
+}
+
+int get_rewind(void){
+	return rewind_state;
+}
+
+unsigned short wait_input(unsigned short input){
+	int new_input;
+
+	/* skip frames to the next change, there is nobody to wait for */
+	while((new_input = get_input(input)) == input){
+		if(next_event == num_events)
+			return -1;
+		frames = events[next_event].frame;
+	}
+
+	return new_input;
+}
+
+void present(const uint64_t screen[][2], int width, int height,
+		int x, int y, int w, int h){
+	assert((width==64 && height==32) || (width==128 && height==64));
+	assert(0<=x && 0<w && x+w<=width);
+	assert(0<=y && 0<h && y+h<=height);
+	(void)screen;
+}
+
+void frame(void){
+	frames++;
+}
+
+void set_title(const char *status){
+	(void)status;
+}
+
+void set_buzzer_state(int state){
+	(void)state;
+}
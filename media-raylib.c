@@ -1,8 +1,10 @@
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <raylib.h>
 
+#include "expand.h"
 #include "media.h"
 
 #define PIXEL_RADIUS 16
@@ -20,6 +22,13 @@
 #define BUZZER_FREQ 440
 #define BUZZER_VOL .05
 
+/*
+ * RGBA the size of the texture, scaled up when drawn: raylib doesn't keep
+ * the back buffer
+ */
+uint32_t pixels[64*128];
+Texture2D texture;
+
 int buzzer_state;
 AudioStream audio;
 
@@ -72,6 +81,10 @@ int m_init(int argc, char **argv){
 	InitWindow(SCREEN_WIDTH, SCREEN_HEIGHT, WINDOW_NAME);
 	SetTargetFPS(60);
 
+	Image image = GenImageColor(64, 32, BG_COLOR);
+	texture = LoadTextureFromImage(image);
+	UnloadImage(image);
+
 	InitAudioDevice();
 	audio = InitAudioStream(SOUND_DEV_FREQ, 8, 1);
 
@@ -87,7 +100,8 @@ void m_quit(void){
 
 	CloseAudioStream(audio);
 	CloseAudioDevice();
-	
+
+	UnloadTexture(texture);
 	CloseWindow();
 }
 
@@ -104,6 +118,10 @@ unsigned short get_input(unsigned short input){
 
 	return input;
 }
+int get_rewind(void){
+	return IsKeyDown(KEY_BACKSPACE);
+}
+
 unsigned short wait_input(unsigned short input){
 	int new_input;
 	
@@ -113,25 +131,45 @@ unsigned short wait_input(unsigned short input){
 	return new_input;
 }
 
-void clear_screen(void){
-	ClearBackground(BG_COLOR);
-}
+void present(const uint64_t screen[][2], int width, int height,
+		int x, int y, int w, int h){
+	assert((width==64 && height==32) || (width==128 && height==64));
+	assert(0<=x && 0<w && x+w<=width);
+	assert(0<=y && 0<h && y+h<=height);
+	(void)x, (void)w; /* whole rows, UpdateTexture() takes all of them */
+
+	if(width != texture.width){
+		UnloadTexture(texture);
+		Image image = GenImageColor(width, height, BG_COLOR);
+		texture = LoadTextureFromImage(image);
+		UnloadImage(image);
+	}
 
-void draw(int x, int y, int value){
-	assert(0<=x && x<64);
-	assert(0<=y && y<32);
-	DrawRectangle(x*PIXEL_RADIUS, y*PIXEL_RADIUS,
-			PIXEL_RADIUS, PIXEL_RADIUS,
-			value ? FG_COLOR : BG_COLOR);
+	uint32_t on, off;
+	memcpy(&on, &FG_COLOR, sizeof(on));
+	memcpy(&off, &BG_COLOR, sizeof(off));
+	for(int i=y ; i<y+h ; i++)
+		for(int j=0 ; j<width ; j+=64)
+			expand32(pixels + i*width + j, screen[i][j/64], 64, on, off);
+	UpdateTexture(texture, pixels);
 }
 
 void frame(void){
 	update_audio();
 
+	ClearBackground(BG_COLOR);
+	DrawTextureEx(texture, (Vector2){0, 0}, 0, (float)SCREEN_WIDTH/texture.width, WHITE);
+
 	EndDrawing();
 	BeginDrawing();
 }
 
+void set_title(const char *status){
+	char title[256];
+	snprintf(title, sizeof(title), "%s - %s", WINDOW_NAME, status);
+	SetWindowTitle(title);
+}
+
 void set_buzzer_state(int state){
 	buzzer_state = state;
 }
@@ -1,8 +1,10 @@
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
 
 #include <SDL2/SDL.h>
 
+#include "expand.h"
 #include "media.h"
 
 #define PIXEL_RADIUS 16
@@ -12,7 +14,6 @@
 
 #define WINDOW_NAME "CHIP-8 emulator"
 
-#define NUM_PIXELS (SCREEN_WIDTH*SCREEN_HEIGHT)
 #define SCREEN_RECT ((SDL_Rect){.x=0,.y=0,.w=SCREEN_WIDTH,.h=SCREEN_HEIGHT})
 
 #define SOUND_DEV_FREQ 48000
@@ -20,8 +21,6 @@
 #define BUZZER_FREQ 440
 #define BUZZER_VOL .05
 
-unsigned char *pixels;
-
 SDL_Window *window;
 SDL_Renderer *renderer;
 SDL_Texture *texture;
@@ -29,6 +28,8 @@ SDL_Texture *texture;
 /* sound state*/
 int buzzer_state = 0;
 
+int rewind_state = 0;
+
 /*
 ┌───┬───┬───┬───┐
 │ 1 │ 2 │ 3 │ C │
@@ -66,9 +67,7 @@ static void buzzer_callback(void* userdata, Uint8* stream, int len){
 int m_init(int argc, char **argv){
 	(void)argc, (void)argv;
 	/*TODO: check every init */
-	
-	pixels = calloc(1,NUM_PIXELS);
-	
+
 	SDL_Init( SDL_INIT_EVERYTHING );
 	window = SDL_CreateWindow(
 			WINDOW_NAME,
@@ -84,6 +83,12 @@ int m_init(int argc, char **argv){
 			renderer,
 			SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STREAMING,
 			SCREEN_WIDTH, SCREEN_HEIGHT);
+	/* present() only ever writes the changed part */
+	unsigned char *texture_pixels;
+	int pitch;
+	SDL_LockTexture(texture, &SCREEN_RECT, (void **)&texture_pixels, &pitch);
+	memset(texture_pixels, 0, SCREEN_HEIGHT*pitch);
+	SDL_UnlockTexture(texture);
 
 	SDL_RenderClear(renderer);
 
@@ -108,8 +113,6 @@ void m_quit(void){
 	SDL_CloseAudio();
 
 	SDL_Quit();
-
-	free(pixels);
 }
 
 unsigned short get_input(unsigned short input){
@@ -120,6 +123,8 @@ unsigned short get_input(unsigned short input){
 			return -1;
 		}
 		if (e.type == SDL_KEYDOWN || e.type == SDL_KEYUP) {
+			if(e.key.keysym.sym == SDLK_BACKSPACE)
+				rewind_state = e.type == SDL_KEYDOWN;
 			for(int i=0;i<16;i++){
 				if(e.key.keysym.sym == keys[i]){
 					if(e.type == SDL_KEYDOWN){
@@ -135,6 +140,10 @@ unsigned short get_input(unsigned short input){
 
 	return input;
 }
+int get_rewind(void){
+	return rewind_state;
+}
+
 unsigned short wait_input(unsigned short input){
 	/* TODO: better version */
 	int new_input;
@@ -145,34 +154,47 @@ unsigned short wait_input(unsigned short input){
 	return new_input;
 }
 
-void clear_screen(void){
-	memset(pixels,0,NUM_PIXELS);
-}
-
-void draw(int x, int y, int value){
-	assert(0<=x && x<64);
-	assert(0<=y && y<32);
-
-	for(int i=0 ; i<PIXEL_RADIUS ; i++){
-		for(int j=0 ; j<PIXEL_RADIUS ; j++){
-			pixels[(y*PIXEL_RADIUS+i)*SCREEN_WIDTH +
-				x*PIXEL_RADIUS+j] = value ? 255 : 0;
+void present(const uint64_t screen[][2], int width, int height,
+		int x, int y, int w, int h){
+	assert((width==64 && height==32) || (width==128 && height==64));
+	assert(0<=x && 0<w && x+w<=width);
+	assert(0<=y && 0<h && y+h<=height);
+
+	/* the texture stays the window size, pixels get smaller */
+	int scale = SCREEN_WIDTH/width;
+	SDL_Rect rect = {
+		.x=x*scale, .y=y*scale,
+		.w=w*scale, .h=h*scale,
+	};
+	unsigned char *texture_pixels;
+	int pitch;
+	SDL_LockTexture(texture, &rect, (void **)&texture_pixels, &pitch);
+	for(int i=0 ; i<h ; i++){
+		/* widen one row a word at a time, then repeat it down the pixel */
+		unsigned char *line = texture_pixels + i*scale*pitch;
+		for(int j=x ; j<x+w ; ){
+			int n = (j/64+1)*64 < x+w ? (j/64+1)*64 - j : x+w - j;
+			expand_scaled(line + (j-x)*scale, screen[y+i][j/64] << j%64, n, scale);
+			j += n;
 		}
+		for(int k=1 ; k<scale ; k++)
+			memcpy(line + k*pitch, line, rect.w);
 	}
+	SDL_UnlockTexture(texture);
 }
 
 void frame(void){
-	void *texture_pixels;
-	int pitch; /* we don't actually use this, yolo */
-	SDL_LockTexture(texture, &SCREEN_RECT, &texture_pixels, &pitch);
-	memcpy(texture_pixels, pixels, NUM_PIXELS);
-	SDL_UnlockTexture(texture);
-
 	SDL_RenderCopy(renderer, texture, &SCREEN_RECT, &SCREEN_RECT);
 	SDL_RenderPresent(renderer);
 	SDL_RenderClear(renderer);
 }
 
+void set_title(const char *status){
+	char title[256];
+	snprintf(title, sizeof(title), "%s - %s", WINDOW_NAME, status);
+	SDL_SetWindowTitle(window, title);
+}
+
 void set_buzzer_state(int state){
 	buzzer_state = state;
 }
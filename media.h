@@ -1,18 +1,31 @@
 #ifndef C8_MEDIA_H
 #define C8_MEDIA_H
 
+#include <stdint.h>
+
 int m_init(int argc, char **argv);
 
 void m_quit(void);
 
 unsigned short get_input(unsigned short input);
 unsigned short wait_input(unsigned short input);
+/* rewind key (Backspace) held down, as of the last get_input() */
+int get_rewind(void);
 
-void clear_screen(void);
-void draw(int x, int y, int value);
+/*
+ * show the screen at the next frame(), width x height (64x32 or 128x64),
+ * two words per row with the leftmost pixel in the top bit of the first;
+ * only the pixels in the rectangle changed since the last call with the
+ * same size
+ */
+void present(const uint64_t screen[][2], int width, int height,
+		int x, int y, int w, int h);
 
 void frame(void);
 
+/* show a status line in the window title */
+void set_title(const char *status);
+
 void set_buzzer_state(int state);
 
 #endif /* C8_MEDIA_H */
@@ -0,0 +1,86 @@
+#include <string.h>
+#include <time.h>
+
+#include "media.h"
+#include "metrics.h"
+
+double now(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec/1e9;
+}
+
+int metrics_open(struct metrics *m, const char *dest, double now){
+	memset(m, 0, sizeof(*m));
+	m->last = m->start = now;
+	if(!strcmp(dest, "stderr"))
+		m->out = stderr;
+	else if(strcmp(dest, "title") && !(m->out = fopen(dest, "w")))
+		return -1;
+	return 0;
+}
+
+static void format(char *line, size_t size, double secs,
+		unsigned long long instructions, unsigned long long frames,
+		unsigned long long shown, unsigned long long sprites,
+		double in_frame, unsigned short keyboard){
+	char keys[17];
+	for(int k=0 ; k<16 ; k++)
+		keys[k] = keyboard & 1<<k ? "0123456789ABCDEF"[k] : '.';
+	keys[16] = '\0';
+
+	snprintf(line, size,
+			"%.2f MIPS, %.1f fps (%.1f shown), %.0f DXYN/s, %.0f%% in frame(), K=[%s]",
+			instructions/secs/1e6, frames/secs, shown/secs,
+			sprites/secs, 100*in_frame/secs, keys);
+}
+
+/* add what's left since the last report to the run */
+static void flush(struct metrics *m, const struct chip8 *c8, double now){
+	m->run_instructions += m->instructions;
+	m->run_frames += m->frames;
+	m->run_shown += m->shown;
+	m->run_in_frame += m->in_frame;
+
+	m->last = now;
+	m->instructions = m->frames = m->shown = 0;
+	m->sprites = c8->sprites;
+	m->in_frame = 0;
+}
+
+void metrics_close(struct metrics *m, const struct chip8 *c8, double now){
+	flush(m, c8, now);
+
+	char line[128];
+	format(line, sizeof(line), now - m->start, m->run_instructions,
+			m->run_frames, m->run_shown, c8->sprites, m->run_in_frame,
+			c8->KEYBOARD);
+
+	if(m->out == stderr)
+		fprintf(stderr, "%s    \n", line);
+	else if(m->out){
+		fprintf(m->out, "%s\n", line);
+		fclose(m->out);
+	}
+}
+
+void metrics_report(struct metrics *m, const struct chip8 *c8, double now){
+	double secs = now - m->last;
+	if(secs < 1.0/METRICS_RATE)
+		return;
+
+	char line[128];
+	format(line, sizeof(line), secs, m->instructions, m->frames, m->shown,
+			c8->sprites - m->sprites, m->in_frame, c8->KEYBOARD);
+
+	if(!m->out)
+		set_title(line);
+	else if(m->out == stderr)
+		fprintf(stderr, "%s    \r", line);
+	else {
+		fprintf(m->out, "%s\n", line);
+		fflush(m->out);
+	}
+
+	flush(m, c8, now);
+}
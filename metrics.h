@@ -0,0 +1,43 @@
+#ifndef C8_METRICS_H
+#define C8_METRICS_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+/* reports per second, at most */
+#define METRICS_RATE 4
+
+/*
+ * Status of the interactive loop: emulated instructions and frames per
+ * second, frames presented, DXYN per second, the share of the time spent
+ * in frame() and the keys held. Goes to stderr (rewritten in place), to a
+ * file (one line per report) or to the window title, and the same for the
+ * whole run when closing, except to the title.
+ */
+struct metrics {
+	FILE *out; /* NULL for the window title */
+	double last; /* time of the last report */
+
+	/* since the last report */
+	unsigned long instructions, frames, shown;
+	unsigned long long sprites; /* c8->sprites at the last report */
+	double in_frame; /* seconds spent in frame() */
+
+	/* the whole run, up to the last report */
+	double start;
+	unsigned long long run_instructions, run_frames, run_shown;
+	double run_in_frame;
+};
+
+/* seconds on the monotonic clock, the now to pass below */
+double now(void);
+
+/* dest is "stderr", "title" or a file name; 0 on success, -1 with errno set */
+int metrics_open(struct metrics *m, const char *dest, double now);
+void metrics_close(struct metrics *m, const struct chip8 *c8, double now);
+
+/* report if it's time, call after presenting a frame */
+void metrics_report(struct metrics *m, const struct chip8 *c8, double now);
+
+#endif /* C8_METRICS_H */
@@ -0,0 +1,100 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+#include "movie.h"
+
+struct header {
+	char magic[4];
+	uint32_t version;
+	uint32_t seed;
+	uint32_t frames;
+	uint64_t rom_hash;
+};
+
+struct movie *movie_new(unsigned seed, const unsigned char *rom, size_t size){
+	struct movie *m = calloc(1, sizeof(*m));
+	if(!m)
+		return NULL;
+	m->seed = seed;
+	m->rom_hash = fnv1a(rom, size);
+	return m;
+}
+
+void movie_free(struct movie *m){
+	if(!m)
+		return;
+	free(m->keys);
+	free(m);
+}
+
+int movie_add(struct movie *m, unsigned short keys){
+	if(m->frames == m->max_frames){
+		unsigned long max_frames = m->max_frames ? 2*m->max_frames : 3600;
+		unsigned short *p = realloc(m->keys, max_frames*sizeof(*p));
+		if(!p)
+			return -1;
+		m->keys = p;
+		m->max_frames = max_frames;
+	}
+	m->keys[m->frames++] = keys;
+	return 0;
+}
+
+int movie_save(const struct movie *m, const char *path){
+	struct header h = {
+		.version = MOVIE_VERSION,
+		.seed = m->seed,
+		.frames = m->frames,
+		.rom_hash = m->rom_hash,
+	};
+	memcpy(h.magic, MOVIE_MAGIC, sizeof(h.magic));
+
+	FILE *f = fopen(path, "wb");
+	if(!f)
+		return -1;
+	int ok = fwrite(&h, sizeof(h), 1, f) == 1
+		&& fwrite(m->keys, sizeof(*m->keys), m->frames, f) == m->frames;
+	if(fclose(f) || !ok)
+		return -1;
+	return 0;
+}
+
+static struct movie *read_movie(FILE *f, const unsigned char *rom, size_t size){
+	struct header h;
+	if(fread(&h, sizeof(h), 1, f) != 1
+			|| memcmp(h.magic, MOVIE_MAGIC, sizeof(h.magic))
+			|| h.version != MOVIE_VERSION
+			|| h.rom_hash != fnv1a(rom, size)){
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct movie *m = movie_new(h.seed, rom, size);
+	if(!m)
+		return NULL;
+	m->keys = malloc((h.frames ? h.frames : 1)*sizeof(*m->keys));
+	if(!m->keys){
+		movie_free(m);
+		return NULL;
+	}
+	if(fread(m->keys, sizeof(*m->keys), h.frames, f) != h.frames){
+		movie_free(m);
+		errno = EINVAL;
+		return NULL;
+	}
+	m->frames = m->max_frames = h.frames;
+	return m;
+}
+
+struct movie *movie_load(const char *path, const unsigned char *rom, size_t size){
+	FILE *f = fopen(path, "rb");
+	if(!f)
+		return NULL;
+	struct movie *m = read_movie(f, rom, size);
+	fclose(f);
+	return m;
+}
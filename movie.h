@@ -0,0 +1,33 @@
+#ifndef C8_MOVIE_H
+#define C8_MOVIE_H
+
+#include <stddef.h>
+
+/*
+ * Movies: the RNG seed and the keys held during every emulated frame, so a
+ * run can be replayed instruction for instruction whatever the media
+ * backend, the engine or the host speed. A movie starts from reset (or
+ * from the same -L state) and is tied to its ROM by a hash.
+ */
+#define MOVIE_MAGIC "C8MV"
+#define MOVIE_VERSION 1
+
+struct movie {
+	unsigned seed;
+	unsigned long long rom_hash;
+
+	unsigned long frames, max_frames;
+	unsigned short *keys;
+};
+
+/* an empty movie to record into */
+struct movie *movie_new(unsigned seed, const unsigned char *rom, size_t size);
+/* NULL with errno set, EINVAL if the file is not a movie of this ROM */
+struct movie *movie_load(const char *path, const unsigned char *rom, size_t size);
+void movie_free(struct movie *m);
+
+/* append one frame, 0 on success, -1 with errno set */
+int movie_add(struct movie *m, unsigned short keys);
+int movie_save(const struct movie *m, const char *path);
+
+#endif /* C8_MOVIE_H */
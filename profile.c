@@ -0,0 +1,69 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+
+#ifdef C8_PROFILE
+_Thread_local unsigned long long profile_count[PROF_COUNT];
+_Thread_local unsigned long long profile_time[PROF_COUNT];
+_Thread_local unsigned long long profile_last;
+
+static const char *const names[PROF_COUNT] = {
+#define X(form) [OP_##form] = #form,
+	OPCODES(X)
+#undef X
+	[PROF_JIT] = "jit",
+	[PROF_IDLE] = "idle",
+	[PROF_INPUT] = "input",
+	[PROF_TICK] = "tick",
+	[PROF_FRAME] = "frame",
+	[PROF_HOST] = "host",
+};
+
+void profile_reset(void){
+	memset(profile_count, 0, sizeof(profile_count));
+	memset(profile_time, 0, sizeof(profile_time));
+	profile_last = profile_clock();
+}
+
+static int by_time(const void *a, const void *b){
+	unsigned long long ta = profile_time[*(const unsigned *)a];
+	unsigned long long tb = profile_time[*(const unsigned *)b];
+	return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+void profile_report(FILE *f){
+	unsigned order[PROF_COUNT];
+	unsigned long long total = 0;
+	for(unsigned i=0 ; i<PROF_COUNT ; i++){
+		order[i] = i;
+		total += profile_time[i];
+	}
+	qsort(order, PROF_COUNT, sizeof(*order), by_time);
+
+	fprintf(f, "%-8s %14s %18s %6s %8s\n", "form", "count", PROFILE_UNIT, "%", "each");
+	for(unsigned i=0 ; i<PROF_COUNT ; i++){
+		unsigned id = order[i];
+		if(!profile_count[id])
+			continue;
+		/* opcode forms in capitals, 8XY4 */
+		char name[16];
+		unsigned k = 0;
+		for( ; names[id][k] && k<sizeof(name)-1 ; k++)
+			name[k] = id < PROF_JIT ? toupper(names[id][k]) : names[id][k];
+		name[k] = '\0';
+		fprintf(f, "%-8s %14llu %18llu %6.2f %8.1f\n", name,
+				profile_count[id], profile_time[id],
+				total ? 100.0*profile_time[id]/total : 0,
+				(double)profile_time[id]/profile_count[id]);
+	}
+}
+#else
+void profile_reset(void){
+}
+
+void profile_report(FILE *f){
+	(void)f;
+}
+#endif
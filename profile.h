@@ -0,0 +1,65 @@
+#ifndef C8_PROFILE_H
+#define C8_PROFILE_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+/*
+ * Profiler, built in with -DC8_PROFILE (make PROFILE=1): the engines count
+ * every instruction form they execute and the host time since the previous
+ * mark, which covers the dispatch as well (DXYN only draws into SCREEN and
+ * marks rows dirty, the drawing on the host is PROF_FRAME). The main loop
+ * marks its own phases the same way. Counters are per thread.
+ * Without C8_PROFILE, PROFILE() compiles to nothing.
+ */
+enum {
+	/* after the OP_* forms */
+	PROF_JIT = OP_unknown+1, /* translated blocks */
+	PROF_IDLE, /* skipped idle loops */
+	PROF_INPUT, /* get_input() */
+	PROF_TICK, /* timers */
+	PROF_FRAME, /* display(), frame() and presenting */
+	PROF_HOST, /* the rest of the main loop */
+	PROF_COUNT
+};
+
+#ifdef C8_PROFILE
+#ifdef __x86_64__
+#include <x86intrin.h>
+#define PROFILE_UNIT "cycles"
+static inline unsigned long long profile_clock(void){
+	return __rdtsc();
+}
+#else
+#include <time.h>
+#define PROFILE_UNIT "ns"
+static inline unsigned long long profile_clock(void){
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec*1000000000ull + t.tv_nsec;
+}
+#endif
+
+extern _Thread_local unsigned long long profile_count[PROF_COUNT];
+extern _Thread_local unsigned long long profile_time[PROF_COUNT];
+extern _Thread_local unsigned long long profile_last;
+
+/* n executions of id end now */
+static inline void profile(unsigned id, unsigned long n){
+	unsigned long long t = profile_clock();
+	profile_count[id] += n;
+	profile_time[id] += t - profile_last;
+	profile_last = t;
+}
+#define PROFILE(id, n) profile(id, n)
+#else
+#define PROFILE(id, n) ((void)(id), (void)(n))
+#endif
+
+/* zero the calling thread's counters and start the clock */
+void profile_reset(void);
+/* table of the calling thread's counters, most time first */
+void profile_report(FILE *f);
+
+#endif /* C8_PROFILE_H */
@@ -0,0 +1,244 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+
+/*
+ * A delta is a list of runs: 16-bit count of unchanged words, 16-bit count
+ * of changed words, then the changed words XORed. Trailing unchanged words
+ * are implicit. Words are 8 bytes, STATE_SIZE is a multiple of that.
+ */
+#define RUN_HEADER 4
+#define WORDS (STATE_SIZE/8)
+#define MAX_DELTA (STATE_SIZE + RUN_HEADER*(WORDS/2+1))
+
+struct record {
+	uint32_t offset, size;
+};
+
+/* state words the core may have written since the last snapshot */
+struct range {
+	uint16_t begin, end;
+};
+
+struct history {
+	unsigned interval, since;
+	int started;
+
+	unsigned char *ring;
+	size_t size, head;
+
+	/* oldest first, a circular list */
+	struct record *records;
+	size_t max_records, first, count;
+
+	unsigned char last[STATE_SIZE];
+	unsigned char delta[MAX_DELTA];
+
+	/* ascending: runs of RAM blocks, runs of screen rows, the registers */
+	struct range written[32+32+1];
+	size_t nwritten;
+};
+
+static void put16(unsigned char *p, unsigned v){
+	p[0] = v;
+	p[1] = v>>8;
+}
+
+static unsigned get16(const unsigned char *p){
+	return p[0] | p[1]<<8;
+}
+
+static uint64_t word(const unsigned char *p, size_t i){
+	uint64_t w;
+	memcpy(&w, p+8*i, 8);
+	return w;
+}
+
+/*
+ * The delta from last to state, bringing last up to date on the way. Only
+ * the written ranges can differ, everything else is left out.
+ */
+static size_t encode(unsigned char *out, const unsigned char *state, unsigned char *last,
+		const struct range *ranges, size_t n){
+	size_t o = 0, next = 0, changed = 0;
+	unsigned char *run = NULL; /* header of the run being written */
+
+	for(size_t r=0 ; r<n ; r++){
+		size_t i = ranges[r].begin;
+		for( ; i<ranges[r].end ; i++){
+			uint64_t w = word(state, i), x = w ^ word(last, i);
+			if(!x && run){
+				put16(run+2, i-changed);
+				run = NULL;
+				next = i;
+			}
+			if(!x)
+				continue;
+			if(!run){
+				run = out+o;
+				put16(run, i-next);
+				changed = i;
+				o += RUN_HEADER;
+			}
+			memcpy(out+o, &x, 8);
+			memcpy(last+8*i, &w, 8);
+			o += 8;
+		}
+		if(run){
+			put16(run+2, i-changed);
+			run = NULL;
+			next = i;
+		}
+	}
+	return o;
+}
+
+/* -1 if the runs don't fit the delta or the state */
+static int apply(unsigned char *state, const unsigned char *delta, size_t size){
+	size_t i = 0;
+	for(size_t o=0 ; o<size ; ){
+		if(o+RUN_HEADER > size)
+			return -1;
+		i += get16(delta+o);
+		unsigned n = get16(delta+o+2);
+		o += RUN_HEADER;
+		if(i+n > WORDS || o+8*n > size)
+			return -1;
+		for( ; n-- ; i++, o+=8){
+			uint64_t x = word(state, i) ^ word(delta+o, 0);
+			memcpy(state+8*i, &x, 8);
+		}
+	}
+	return 0;
+}
+
+struct history *history_new(size_t size, unsigned interval){
+	struct history *h = calloc(1, sizeof(*h));
+	if(!h)
+		return NULL;
+
+	h->interval = interval ? interval : 1;
+	h->size = size;
+	h->ring = malloc(size);
+	/* frames where nothing changed make empty records, cap their number */
+	h->max_records = size/16 + 1;
+	h->records = malloc(h->max_records*sizeof(*h->records));
+	if(!h->ring || !h->records){
+		history_free(h);
+		return NULL;
+	}
+	return h;
+}
+
+void history_free(struct history *h){
+	if(!h)
+		return;
+	free(h->records);
+	free(h->ring);
+	free(h);
+}
+
+/* an empty record still holds its place, writing over it drops it too */
+static int overlaps(const struct record *r, size_t offset, size_t size){
+	size_t end = r->offset + (r->size ? r->size : 1);
+	return r->offset < offset+size && offset < end;
+}
+
+static void drop_oldest(struct history *h){
+	h->first = (h->first+1) % h->max_records;
+	h->count--;
+}
+
+static void push(struct history *h, const unsigned char *state){
+	size_t size = encode(h->delta, state, h->last, h->written, h->nwritten);
+
+	if(size > h->size){ /* can't go back past this one */
+		h->count = 0;
+	} else {
+		/* wrapping around, what is left past the head is the oldest */
+		if(h->head+size > h->size){
+			while(h->count && h->records[h->first].offset >= h->head)
+				drop_oldest(h);
+			h->head = 0;
+		}
+		while(h->count && (h->count == h->max_records
+					|| overlaps(&h->records[h->first], h->head, size)))
+			drop_oldest(h);
+
+		memcpy(h->ring+h->head, h->delta, size);
+		h->records[(h->first+h->count++) % h->max_records] =
+			(struct record){.offset = h->head, .size = size};
+		h->head += size;
+	}
+}
+
+/* offset and size in bytes, multiples of 8 */
+static void mark(struct history *h, size_t offset, size_t size){
+	size_t begin = offset/8, end = (offset+size)/8;
+	if(h->nwritten && h->written[h->nwritten-1].end == begin)
+		h->written[h->nwritten-1].end = end;
+	else
+		h->written[h->nwritten++] = (struct range){begin, end};
+}
+
+/* bit k of mask stands for size bytes at offset+k*size, one mark() per run */
+static void mark_bits(struct history *h, uint64_t mask, size_t offset, size_t size){
+	while(mask){
+		unsigned first = __builtin_ctzll(mask);
+		uint64_t run = ~(mask >> first);
+		unsigned n = run ? (unsigned)__builtin_ctzll(run) : 64-first;
+		mark(h, offset + first*size, n*size);
+		mask = first+n < 64 ? mask >> (first+n) << (first+n) : 0;
+	}
+}
+
+/* turn what the core wrote since the last call into ranges, and clear it */
+static void collect(struct history *h, struct chip8 *c8){
+	h->nwritten = 0;
+	mark_bits(h, c8->ram_written, offsetof(struct chip8, RAM), 64);
+	mark_bits(h, c8->rows_written, offsetof(struct chip8, SCREEN), sizeof(c8->SCREEN[0]));
+	/* registers, stack and the rest are small, always compared */
+	size_t rest = offsetof(struct chip8, SCREEN) + sizeof(c8->SCREEN);
+	mark(h, rest, STATE_SIZE - rest);
+	c8->ram_written = c8->rows_written = 0;
+}
+
+void history_frame(struct history *h, struct chip8 *c8){
+	if(!h->started){
+		memcpy(h->last, c8, STATE_SIZE);
+		c8->ram_written = c8->rows_written = 0;
+		h->started = 1;
+		h->since = 0;
+		return;
+	}
+	if(++h->since < h->interval)
+		return;
+	h->since = 0;
+	collect(h, c8);
+	push(h, (const unsigned char *)c8);
+}
+
+int history_back(struct history *h, struct chip8 *c8){
+	if(!h->started)
+		return 0;
+
+	/* first back to the newest snapshot if the machine moved on */
+	if(!h->since){
+		if(!h->count)
+			return 0;
+		struct record *r = &h->records[(h->first+--h->count) % h->max_records];
+		if(apply(h->last, h->ring+r->offset, r->size)){
+			/* last is damaged, start over from the next frame */
+			h->count = 0;
+			h->started = 0;
+			return 0;
+		}
+		h->head = r->offset;
+	}
+	h->since = 0;
+	restore(c8, h->last);
+	return 1;
+}
@@ -0,0 +1,28 @@
+#ifndef C8_REWIND_H
+#define C8_REWIND_H
+
+#include <stddef.h>
+
+#include "chip8.h"
+
+/*
+ * Rewind history: a snapshot of the machine every few frames, kept in a
+ * fixed size ring as XOR deltas to the snapshot before it, run-length
+ * encoded. Only the newest snapshot is kept whole; stepping back applies
+ * the newest delta to it. When the ring is full the oldest go first.
+ * Only the RAM blocks and screen rows the core marked as written since the
+ * last snapshot are compared, see ram_written and rows_written.
+ */
+struct history;
+
+/* a ring of the given size in bytes, one snapshot every interval frames */
+struct history *history_new(size_t size, unsigned interval);
+void history_free(struct history *h);
+
+/* call after every emulated frame, clears the core's written masks */
+void history_frame(struct history *h, struct chip8 *c8);
+
+/* restore the previous snapshot into c8, 0 when there is none left */
+int history_back(struct history *h, struct chip8 *c8);
+
+#endif /* C8_REWIND_H */
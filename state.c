@@ -0,0 +1,61 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "state.h"
+
+struct header {
+	char magic[4];
+	uint32_t version;
+	uint32_t size; /* STATE_SIZE of the writer */
+	uint32_t reserved;
+};
+
+#define MAPPED_SIZE (sizeof(struct header)+STATE_SIZE)
+
+int save_state(const struct chip8 *c8, const char *path){
+	struct header h = {.version = STATE_VERSION, .size = STATE_SIZE};
+	memcpy(h.magic, STATE_MAGIC, sizeof(h.magic));
+
+	FILE *f = fopen(path, "wb");
+	if(!f)
+		return -1;
+	int ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(c8, STATE_SIZE, 1, f) == 1;
+	if(fclose(f) || !ok)
+		return -1;
+	return 0;
+}
+
+const void *map_state(const char *path){
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	struct stat st;
+	void *p = MAP_FAILED;
+	if(!fstat(fd, &st) && st.st_size == MAPPED_SIZE)
+		p = mmap(NULL, MAPPED_SIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+	else
+		errno = EINVAL;
+	close(fd);
+	if(p == MAP_FAILED)
+		return NULL;
+
+	const struct header *h = p;
+	if(memcmp(h->magic, STATE_MAGIC, sizeof(h->magic))
+			|| h->version != STATE_VERSION || h->size != STATE_SIZE){
+		munmap(p, MAPPED_SIZE);
+		errno = EINVAL;
+		return NULL;
+	}
+	return h+1;
+}
+
+void unmap_state(const void *state){
+	munmap((struct header *)state - 1, MAPPED_SIZE);
+}
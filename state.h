@@ -0,0 +1,24 @@
+#ifndef C8_STATE_H
+#define C8_STATE_H
+
+#include "chip8.h"
+
+/*
+ * Save state files: a small header followed by the STATE_SIZE bytes of the
+ * machine as they are in memory, so loading is a mapping and a memcpy.
+ * The version changes with the layout of struct chip8.
+ */
+#define STATE_MAGIC "C8ST"
+#define STATE_VERSION 3
+
+/* 0 on success, -1 with errno set */
+int save_state(const struct chip8 *c8, const char *path);
+
+/*
+ * Loading keeps the file mapped, to restore() it any number of times,
+ * NULL with errno set on failure
+ */
+const void *map_state(const char *path);
+void unmap_state(const void *state);
+
+#endif /* C8_STATE_H */
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "trace.h"
+
+struct trace *trace_new(void){
+	return calloc(1, sizeof(struct trace));
+}
+
+void trace_free(struct trace *t){
+	free(t);
+}
+
+int trace_dump(const struct trace *t, const char *path){
+	FILE *f = fopen(path, "w");
+	if(!f)
+		return -1;
+
+	unsigned long long first = t->count > TRACE_SIZE ? t->count-TRACE_SIZE : 0;
+	fprintf(f, "# records %llu..%llu: PC, instruction, then I and V[x] after it\n",
+			first, t->count);
+	for(unsigned long long i=first ; i<t->count ; i++){
+		const struct trace_record *r = &t->r[i & (TRACE_SIZE-1)];
+		fprintf(f, "%03X %04X I=%03X V%X=%02X", (unsigned)r->pc, (unsigned)r->instr,
+				(unsigned)r->I, (unsigned)(r->instr>>8 & 15), (unsigned)r->vx);
+		if(r->n != 1)
+			fprintf(f, " (%u instructions)", (unsigned)r->n);
+		fputc('\n', f);
+	}
+
+	int err = ferror(f);
+	if(fclose(f) || err)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef C8_TRACE_H
+#define C8_TRACE_H
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+/*
+ * Execution trace, built in with -DC8_TRACE (make TRACE=1): every engine
+ * appends one record per instruction to a ring in the machine, overwriting
+ * the oldest. There is a single writer and no lock, the ring is dumped
+ * between run() calls. Without C8_TRACE, TRACE() compiles to nothing.
+ */
+#define TRACE_SIZE (1<<16) /* records, a power of 2 */
+
+struct trace_record {
+	unsigned short pc, instr, I; /* I after the instruction */
+	unsigned char vx; /* V[x] of instr after the instruction */
+	unsigned char n; /* instructions covered: jit blocks and idle loops */
+};
+
+struct trace {
+	unsigned long long count; /* records ever written */
+	int faulted; /* there was a WARN() */
+	struct trace_record r[TRACE_SIZE];
+};
+
+#ifdef C8_TRACE
+static inline void trace(struct chip8 *c8, unsigned pc, unsigned instr, unsigned long n){
+	struct trace *t = c8->trace;
+	if(!t)
+		return;
+	struct trace_record *r = &t->r[t->count++ & (TRACE_SIZE-1)];
+	r->pc = pc;
+	r->instr = instr;
+	r->I = c8->I;
+	r->vx = c8->V[instr>>8 & 15];
+	r->n = n < 255 ? n : 255;
+}
+#define TRACE(c8, pc, instr, n) trace(c8, pc, instr, n)
+#define TRACE_FAULT(c8) ((void)((c8)->trace && ((c8)->trace->faulted = 1)))
+#else
+#define TRACE(c8, pc, instr, n) ((void)(c8), (void)(pc), (void)(instr), (void)(n))
+#define TRACE_FAULT(c8) ((void)(c8))
+#endif
+
+/* a fault of the program running on c8, which must be in scope */
+#define WARN(...) (TRACE_FAULT(c8), fprintf(stderr, __VA_ARGS__))
+
+struct trace *trace_new(void);
+void trace_free(struct trace *t);
+
+/* write the ring as text, oldest first, 0 on success, -1 with errno set */
+int trace_dump(const struct trace *t, const char *path);
+
+#endif /* C8_TRACE_H */